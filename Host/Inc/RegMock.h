@@ -0,0 +1,45 @@
+#ifndef REGMOCK_H_
+#define REGMOCK_H_
+
+// Angle brackets, so it is found through -IInc and the wrapper's #include_next reaches CMSIS
+#include <stm32f4xx.h>
+
+/* RAM-backed stand-ins for the peripherals used by SPI.c. Build SPI.c with
+ * -DSPI_REG_MOCK and Host/Inc on the include path to route every register
+ * access here instead of to the STM32 memory map. */
+
+typedef uint8_t (*RegMock_SpiSlave)(uint8_t mosi);
+
+extern SPI_TypeDef			Mock_SPI2;
+extern GPIO_TypeDef			Mock_GPIOB;
+extern RCC_TypeDef			Mock_RCC;
+extern DMA_TypeDef			Mock_DMA1;
+extern DMA_Stream_TypeDef	Mock_DMA1_Stream3;
+extern DMA_Stream_TypeDef	Mock_DMA1_Stream4;
+
+#define SPI2_REGS				(&Mock_SPI2)
+#define SPI2_GPIO				(&Mock_GPIOB)
+#define SPI2_RCC				(&Mock_RCC)
+#define SPI2_DMA				(&Mock_DMA1)
+#define SPI2_DMA_RX_STREAM		(&Mock_DMA1_Stream3)
+#define SPI2_DMA_TX_STREAM		(&Mock_DMA1_Stream4)
+#define SPI2_DMA_ADDRESS(ptr)	RegMock_MapAddress((const volatile void *)(ptr))
+#define SPI2_DMA_IRQ_ENABLE()	RegMock_EnableIRQ()
+#define SPI2_DMA_POLL()			RegMock_ServiceDMA()
+#define SPI2_IRQ_SAVE()			RegMock_GetPrimask()
+#define SPI2_IRQ_DISABLE()		RegMock_DisableIRQ()
+#define SPI2_IRQ_RESTORE(state)	RegMock_SetPrimask(state)
+
+void RegMock_Init(RegMock_SpiSlave slave);
+uint32_t RegMock_MapAddress(const volatile void *ptr);
+void RegMock_EnableIRQ(void);
+void RegMock_ServiceDMA(void);
+uint32_t RegMock_DMABytes(void);
+uint32_t RegMock_GetPrimask(void);
+void RegMock_DisableIRQ(void);
+void RegMock_SetPrimask(uint32_t state);
+uint32_t RegMock_IrqDisables(void);
+
+void DMA1_Stream3_IRQHandler(void);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef SIMTICK_H_
+#define SIMTICK_H_
+
+#include <stdint.h>
+
+/* SYSTICK.h on the host, driven by the virtual clock of the W25Q simulator
+ * instead of SysTick and the DWT. Waiting never blocks: sleeping jumps the
+ * clock to the next tick and every cycle counter poll costs a little time. */
+
+// Clock tree CLOCK_Init() sets up on target
+#define SIMTICK_HCLK_HZ		84000000ULL
+
+// Virtual time one pass of a polling loop takes
+#define SIMTICK_POLL_NS		100
+
+void SimTick_Idle(void);
+
+#endif
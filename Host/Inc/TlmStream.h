@@ -0,0 +1,37 @@
+#ifndef TLMSTREAM_H_
+#define TLMSTREAM_H_
+
+#include <stdint.h>
+#include "TELEMETRY.h"
+#include "COBS.h"
+
+/* Receiving end of the board's telemetry link. Bytes are split into frames
+ * at 0x00, each frame is COBS-decoded and CRC-checked, and the records
+ * rebuild the erase count and block map tables. Shared by tlm_decode and
+ * the host tests. */
+
+#define TLM_STREAM_MAX_BLOCKS	256
+
+typedef struct
+{
+	uint32_t eraseCount[TLM_STREAM_MAX_BLOCKS];
+	uint8_t blockMap[TLM_STREAM_MAX_BLOCKS];
+	uint16_t blockCount;
+	uint32_t blockSize;
+	uint32_t records;
+	uint32_t badFrames;
+	uint32_t lostRecords;
+	uint8_t nextSequence;
+	uint8_t synced;
+	// Print every record as it is decoded
+	uint8_t verbose;
+	// Frame being collected
+	uint8_t frame[COBS_MAX_ENCODED(TLM_MAX_RECORD) + 1];
+	uint32_t frameLength;
+	uint8_t overflow;
+} TlmState;
+
+void TlmStream_Feed(TlmState *state, const uint8_t *data, uint32_t length);
+void TlmStream_Frame(TlmState *state, const uint8_t *frame, uint32_t length);
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef W25QSIM_H_
+#define W25QSIM_H_
+
+#include <stdint.h>
+
+/* Byte-level model of a W25Q64FV behind the SPI bus. It decodes the
+ * opcodes in W25Qxx.h, keeps the array in an mmap'ed image file, only lets
+ * programming clear bits, erases to 0xFF, counts erases per sector and
+ * keeps the chip BUSY for the datasheet typical times of a virtual clock.
+ * Program and erase take effect when CS rises, like on the real part.
+ *
+ * Image file layout:
+ *	8 MB array | 3 x 256 B security registers | 2048 x u32 sector erase counts */
+
+#define W25QSIM_BYTE_COUNT			8388608
+#define W25QSIM_PAGE_SIZE			256
+#define W25QSIM_SECTOR_SIZE			4096
+#define W25QSIM_SECTOR_COUNT		(W25QSIM_BYTE_COUNT / W25QSIM_SECTOR_SIZE)
+#define W25QSIM_SECURITY_REGS		3
+#define W25QSIM_SECURITY_SIZE		256
+#define W25QSIM_IMAGE_SIZE			(W25QSIM_BYTE_COUNT + (W25QSIM_SECURITY_REGS * W25QSIM_SECURITY_SIZE) + \
+									 (W25QSIM_SECTOR_COUNT * 4))
+
+// Chips behind separate chip selects, each with its own image and state
+#define W25QSIM_MAX_CHIPS			4
+
+#define W25QSIM_JEDEC_ID			0xEF4017
+#define W25QSIM_DEVICE_ID			0x16
+
+// Datasheet typical times in nanoseconds, see W25QSim_SetTiming()
+typedef struct
+{
+	uint64_t pageProgramNs;		// tPP
+	uint64_t sectorEraseNs;		// tSE, also security register erase
+	uint64_t block32kEraseNs;	// tBE1
+	uint64_t block64kEraseNs;	// tBE2
+	uint64_t chipEraseNs;		// tCE
+	uint64_t statusWriteNs;		// tW
+	uint64_t suspendNs;			// tSUS
+} W25QSim_Timing;
+
+typedef struct
+{
+	uint64_t bytesRead;
+	uint64_t bytesProgrammed;
+	uint32_t pagePrograms;
+	uint32_t sectorErases;
+	uint32_t block32kErases;
+	uint32_t block64kErases;
+	uint32_t chipErases;
+	uint32_t securityErases;
+	uint32_t securityPrograms;
+	// Commands the chip dropped: sent while busy, powered down or without WEL
+	uint32_t ignoredCommands;
+	// Bytes whose program data asked for a 0 bit to become 1 again
+	uint32_t programConflicts;
+	uint32_t suspends;
+} W25QSim_Stats;
+
+int W25QSim_Open(const char *path);
+void W25QSim_Close(void);
+void W25QSim_SelectChip(uint8_t index);
+
+// Bus
+void W25QSim_Select(void);
+void W25QSim_Deselect(void);
+uint8_t W25QSim_Transfer(uint8_t mosi);
+
+// Virtual clock
+uint64_t W25QSim_Now(void);
+void W25QSim_Advance(uint64_t ns);
+void W25QSim_SetTiming(const W25QSim_Timing *timing);
+
+// Inspection
+const W25QSim_Stats *W25QSim_GetStats(void);
+void W25QSim_ResetStats(void);
+uint32_t W25QSim_SectorEraseCount(uint32_t sector);
+const uint8_t *W25QSim_Array(void);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef WORKLOAD_H_
+#define WORKLOAD_H_
+
+#include <stdint.h>
+#include "SWAP_FS.h"
+
+/* Synthetic write patterns over the SWAP_FS logical blocks, shared by the
+ * host tools. A source is seeded explicitly and holds all of its state, so
+ * each thread can run its own without locking and a seed always replays
+ * the same block sequence. */
+
+// Hot-spot split: WORKLOAD_HOT_WRITES percent of the writes go to WORKLOAD_HOT_BLOCKS percent of the blocks
+#define WORKLOAD_HOT_WRITES		80
+#define WORKLOAD_HOT_BLOCKS		20
+
+#define WORKLOAD_ZIPF_EXPONENT	1.0
+
+// Bursty writers send WORKLOAD_BURST_LENGTH writes to one block, then stay idle
+#define WORKLOAD_BURST_LENGTH	8
+#define WORKLOAD_BURST_IDLE_MS	1000
+
+typedef enum
+{
+	WORKLOAD_UNIFORM = 0,
+	WORKLOAD_SEQUENTIAL,
+	WORKLOAD_HOTSPOT,
+	WORKLOAD_ZIPF,
+	WORKLOAD_BURSTY,
+	WORKLOAD_COUNT
+} Workload;
+
+typedef struct
+{
+	Workload workload;
+	uint64_t state;
+	uint32_t next;
+	uint32_t burstLeft;
+	uint32_t burstBlock;
+	double zipfCdf[TOTAL_BLOCKS];
+} Workload_Source;
+
+const char *Workload_Name(Workload workload);
+int Workload_Parse(const char *name);
+void Workload_Init(Workload_Source *source, Workload workload, uint64_t seed);
+uint8_t Workload_Next(Workload_Source *source, uint32_t *idleMs);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef HOST_STM32F4XX_H_
+#define HOST_STM32F4XX_H_
+
+/* Host builds use the real device header for types and register layouts,
+ * but __WFI() waits for the next tick of the simulated clock. Host/Inc must
+ * come before the CMSIS directories on the include path. */
+#include_next "stm32f4xx.h"
+#include "SimTick.h"
+
+#undef __WFI
+#define __WFI()		SimTick_Idle()
+
+#endif
@@ -0,0 +1,311 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SWAP_FS.h"
+#include "Workload.h"
+
+/* Monte Carlo lifetime simulator: runs the SWAP_FS block selection
+ * (SFS_SelectBlock(), the same code SFS_WriteData() uses) on RAM tables
+ * until the first physical block reaches the erase endurance, for many
+ * seeds and workloads spread over a thread pool. There is no flash model
+ * and no timing, only erase counting, so a trial is a few million table
+ * updates.
+ * Usage: life_sim [-w workload] [-t trials] [-e endurance] [-s swap-threshold]
+ *                 [-r seed] [-d writes-per-day] [-p threads] [-c trials.csv]
+ * Every write erases one block, physical wear is tracked apart from the
+ * erase counts SWAP_FS keeps, since those are indexed by logical block. */
+
+#define LIFE_DEFAULT_TRIALS		100
+#define LIFE_DEFAULT_ENDURANCE	100000
+#define LIFE_DEFAULT_PER_DAY	1000
+
+typedef struct
+{
+	Workload workload;
+	uint32_t trial;
+	uint64_t seed;
+	// Results
+	uint64_t writes;			// Writes up to and including the one that wore a block out
+	uint8_t failedBlock;		// Physical block that reached the endurance
+	double meanWear;			// Average physical wear at failure, as a fraction of endurance
+} LifeTrial;
+
+typedef struct
+{
+	LifeTrial *trials;
+	uint32_t count;
+	uint32_t next;
+	uint32_t done;
+	uint32_t endurance;
+	pthread_mutex_t lock;
+} LifePool;
+
+/**
+ * @brief	Writes until the first physical block wears out
+ */
+static void Life_RunTrial(LifeTrial *trial, uint32_t endurance)
+{
+	uint32_t eraseCountArray[TOTAL_BLOCKS] = {0};
+	uint8_t blockMapArray[TOTAL_BLOCKS];
+	uint32_t wear[TOTAL_BLOCKS] = {0};
+	Workload_Source source;
+	uint64_t total = 0;
+	uint8_t physicalBlock;
+
+	for(uint32_t i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		blockMapArray[i] = i;
+	}
+	Workload_Init(&source, trial->workload, trial->seed);
+	trial->writes = 0;
+	do
+	{
+		uint8_t block = Workload_Next(&source, NULL);
+
+		physicalBlock = SFS_SelectBlock(eraseCountArray, block);
+		SFS_RecordWrite(eraseCountArray, blockMapArray, block, physicalBlock);
+		trial->writes++;
+	}
+	while(++wear[physicalBlock] < endurance);
+
+	for(uint32_t i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		total += wear[i];
+	}
+	trial->failedBlock = physicalBlock;
+	trial->meanWear = (double)total / TOTAL_BLOCKS / endurance;
+}
+
+static void *Life_Worker(void *argument)
+{
+	LifePool *pool = argument;
+	uint32_t index;
+
+	for(;;)
+	{
+		pthread_mutex_lock(&pool->lock);
+		index = pool->next++;
+		pthread_mutex_unlock(&pool->lock);
+		if(index >= pool->count)
+		{
+			return NULL;
+		}
+		Life_RunTrial(&pool->trials[index], pool->endurance);
+
+		pthread_mutex_lock(&pool->lock);
+		pool->done++;
+		fprintf(stderr, "\r%u/%u trials", pool->done, pool->count);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+/**
+ * @brief	Runs every trial of the pool on threadCount threads
+ * @return	0 on success, -1 if no thread could be started
+ */
+static int Life_RunPool(LifePool *pool, uint32_t threadCount)
+{
+	pthread_t *threads = calloc(threadCount, sizeof(pthread_t));
+	uint32_t started = 0;
+
+	if(threads == NULL)
+	{
+		return -1;
+	}
+	pthread_mutex_init(&pool->lock, NULL);
+	for(; started < threadCount; started++)
+	{
+		if(pthread_create(&threads[started], NULL, Life_Worker, pool) != 0)
+		{
+			break;
+		}
+	}
+	// Whatever threads did start still drain the whole queue
+	for(uint32_t i = 0; i < started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	free(threads);
+	fprintf(stderr, "\n");
+	return (started > 0) ? 0 : -1;
+}
+
+static int Life_CompareWrites(const void *a, const void *b)
+{
+	uint64_t left = *(const uint64_t *)a;
+	uint64_t right = *(const uint64_t *)b;
+
+	return (left > right) - (left < right);
+}
+
+// Nearest-rank percentile of a sorted array
+static uint64_t Life_Percentile(const uint64_t *sorted, uint32_t count, uint32_t percent)
+{
+	uint32_t rank = ((uint64_t)percent * count + 99) / 100;
+
+	return sorted[(rank > 0) ? rank - 1 : 0];
+}
+
+static void Life_Summarize(Workload workload, const LifeTrial *trials, uint32_t trialCount, uint32_t perDay)
+{
+	uint64_t *writes = malloc(trialCount * sizeof(uint64_t));
+	double meanWrites = 0;
+	double meanWear = 0;
+	uint64_t median;
+
+	if(writes == NULL)
+	{
+		return;
+	}
+	for(uint32_t i = 0; i < trialCount; i++)
+	{
+		writes[i] = trials[i].writes;
+		meanWrites += trials[i].writes;
+		meanWear += trials[i].meanWear;
+	}
+	meanWrites /= trialCount;
+	meanWear /= trialCount;
+	qsort(writes, trialCount, sizeof(uint64_t), Life_CompareWrites);
+	median = Life_Percentile(writes, trialCount, 50);
+
+	printf("%-10s %10llu %10llu %10llu %12.0f %10llu %10llu %8.2f %7.1f%%\n",
+		   Workload_Name(workload), (unsigned long long)writes[0],
+		   (unsigned long long)Life_Percentile(writes, trialCount, 10), (unsigned long long)median,
+		   meanWrites, (unsigned long long)Life_Percentile(writes, trialCount, 90),
+		   (unsigned long long)writes[trialCount - 1], median / (perDay * 365.25), meanWear * 100);
+	free(writes);
+}
+
+static int Life_WriteCsv(const char *path, const LifeTrial *trials, uint32_t count, uint32_t perDay)
+{
+	FILE *csv = fopen(path, "w");
+
+	if(csv == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+	fprintf(csv, "workload,trial,seed,writes,years,failed_block,mean_wear\n");
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const LifeTrial *t = &trials[i];
+
+		fprintf(csv, "%s,%u,%llu,%llu,%.4f,%u,%.6f\n", Workload_Name(t->workload), t->trial,
+				(unsigned long long)t->seed, (unsigned long long)t->writes,
+				t->writes / (perDay * 365.25), t->failedBlock, t->meanWear);
+	}
+	fclose(csv);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	LifePool pool;
+	int selected = -1;
+	uint32_t trialCount = LIFE_DEFAULT_TRIALS;
+	uint32_t perDay = LIFE_DEFAULT_PER_DAY;
+	long online = sysconf(_SC_NPROCESSORS_ONLN);
+	uint32_t threadCount = (online > 0) ? online : 1;
+	uint32_t workloadCount;
+	uint64_t seed = 1;
+	const char *csvPath = NULL;
+	struct timespec start, end;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.endurance = LIFE_DEFAULT_ENDURANCE;
+	for(int i = 1; i < argc; i++)
+	{
+		if(i + 1 < argc && strcmp(argv[i], "-w") == 0)
+		{
+			selected = Workload_Parse(argv[++i]);
+			if(selected < 0)
+			{
+				fprintf(stderr, "unknown workload %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-t") == 0)
+		{
+			trialCount = strtoul(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-e") == 0)
+		{
+			pool.endurance = strtoul(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+		{
+			SFS_SetSwapThreshold(strtoul(argv[++i], NULL, 0));
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-r") == 0)
+		{
+			seed = strtoull(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-d") == 0)
+		{
+			perDay = strtoul(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-p") == 0)
+		{
+			threadCount = strtoul(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-c") == 0)
+		{
+			csvPath = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-w workload] [-t trials] [-e endurance] [-s swap-threshold] "
+							"[-r seed] [-d writes-per-day] [-p threads] [-c trials.csv]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(trialCount == 0 || pool.endurance == 0 || perDay == 0 || threadCount == 0)
+	{
+		fprintf(stderr, "trials, endurance, writes per day and threads must be above 0\n");
+		return 1;
+	}
+
+	// Trials of one workload are contiguous, so each summary is a slice
+	workloadCount = (selected >= 0) ? 1 : WORKLOAD_COUNT;
+	pool.count = workloadCount * trialCount;
+	pool.trials = calloc(pool.count, sizeof(LifeTrial));
+	if(pool.trials == NULL)
+	{
+		return 1;
+	}
+	for(uint32_t i = 0; i < pool.count; i++)
+	{
+		pool.trials[i].workload = (selected >= 0) ? (Workload)selected : (Workload)(i / trialCount);
+		pool.trials[i].trial = i % trialCount;
+		pool.trials[i].seed = seed + (i % trialCount);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if(Life_RunPool(&pool, threadCount) != 0)
+	{
+		fprintf(stderr, "could not start worker threads\n");
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	printf("endurance %u, swap threshold %u, %u writes/day, %u trials on %u threads in %.2f s\n",
+		   pool.endurance, SFS_GetSwapThreshold(), perDay, pool.count, threadCount,
+		   (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9));
+	printf("%-10s %10s %10s %10s %12s %10s %10s %8s %8s\n", "workload", "min", "p10", "median",
+		   "mean", "p90", "max", "years", "wear");
+	for(uint32_t w = 0; w < workloadCount; w++)
+	{
+		Life_Summarize(pool.trials[w * trialCount].workload, &pool.trials[w * trialCount], trialCount, perDay);
+	}
+
+	if(csvPath != NULL && Life_WriteCsv(csvPath, pool.trials, pool.count, perDay) != 0)
+	{
+		return 1;
+	}
+	free(pool.trials);
+	return 0;
+}
@@ -0,0 +1,97 @@
+#include "W25Qxx.h"
+#include "W25QSim.h"
+#include "SimTick.h"
+
+/* Host port: every device talks to the one simulated W25Q64FV, and each
+ * byte costs eight SCK periods of virtual time at the selected divider.
+ * Background reads finish before bulkStart returns. */
+
+// PCLK1 after CLOCK_Init(), SCK = PCLK1 / 2^(BR+1)
+#define SIMPORT_PCLK_HZ		42000000ULL
+
+static uint8_t baudRate = SPI_BAUD_SLOWEST;
+
+static void SimPort_Init(W25Q_Device *device)
+{
+	(void)device;
+	W25QSim_Deselect();
+}
+
+static void SimPort_Select(W25Q_Device *device)
+{
+	(void)device;
+	W25QSim_Select();
+}
+
+static void SimPort_Deselect(W25Q_Device *device)
+{
+	(void)device;
+	W25QSim_Deselect();
+}
+
+static uint8_t SimPort_Transfer(W25Q_Device *device, uint8_t data)
+{
+	(void)device;
+	W25QSim_Advance((8ULL * 1000000000ULL) / (SIMPORT_PCLK_HZ >> (baudRate + 1)));
+	return W25QSim_Transfer(data);
+}
+
+static void SimPort_Bulk(W25Q_Device *device, const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	uint8_t miso;
+
+	for(uint16_t i = 0; i < size; i++)
+	{
+		miso = SimPort_Transfer(device, (txData != NULL) ? txData[i] : 0xFF);
+		if(rxData != NULL)
+		{
+			rxData[i] = miso;
+		}
+	}
+}
+
+static void SimPort_BulkStart(W25Q_Device *device, uint8_t *rxData, uint16_t size)
+{
+	SimPort_Bulk(device, NULL, rxData, size);
+}
+
+static void SimPort_BulkWait(W25Q_Device *device)
+{
+	(void)device;
+}
+
+static uint8_t SimPort_SetBaudRate(W25Q_Device *device, uint8_t rate)
+{
+	uint8_t fastest = SPI_BAUD_FASTEST;
+
+	(void)device;
+	// Same SPI2_MAX_SCK_HZ limit as the target
+	while(fastest < SPI_BAUD_SLOWEST && (SIMPORT_PCLK_HZ >> (fastest + 1)) > SPI2_MAX_SCK_HZ)
+	{
+		fastest++;
+	}
+	baudRate = (rate < fastest) ? fastest : (rate > SPI_BAUD_SLOWEST) ? SPI_BAUD_SLOWEST : rate;
+	return baudRate;
+}
+
+static uint32_t SimPort_Micros(void)
+{
+	// Spinning on the clock must let virtual time pass
+	W25QSim_Advance(SIMTICK_POLL_NS);
+	return get_micros();
+}
+
+const W25Q_Port W25Q_DefaultPort =
+{
+	.init = SimPort_Init,
+	.select = SimPort_Select,
+	.deselect = SimPort_Deselect,
+	.transfer = SimPort_Transfer,
+	.bulk = SimPort_Bulk,
+	.bulkStart = SimPort_BulkStart,
+	.bulkWait = SimPort_BulkWait,
+	.setBaudRate = SimPort_SetBaudRate,
+	.wait = SimTick_Idle,
+	.millis = get_ticks,
+	.micros = SimPort_Micros
+};
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "W25Qxx.h"
+#include "SWAP_FS.h"
+#include "W25QSim.h"
+
+/* Runs the firmware's file system against the simulated W25Q64FV: the
+ * same init sequence and write loop as main.c, then a summary of what the
+ * chip went through. Usage: w25q_sim [-i image] [-n writes] [-b block]
+ * [-l length] [-s swap-threshold]
+ *	-i	keep the flash in this image file across runs, RAM-only by default */
+
+static double SimRun_Seconds(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + ((end.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static void SimRun_Report(uint32_t writes, double hostSeconds)
+{
+	const W25QSim_Stats *stats = W25QSim_GetStats();
+	uint32_t highest = 0;
+	uint32_t worn = 0;
+	uint64_t total = 0;
+
+	for(uint32_t sector = 0; sector < W25QSIM_SECTOR_COUNT; sector++)
+	{
+		uint32_t count = W25QSim_SectorEraseCount(sector);
+
+		highest = (count > highest) ? count : highest;
+		worn += (count != 0);
+		total += count;
+	}
+
+	printf("writes               %u\n", writes);
+	printf("simulated time       %.3f s\n", W25QSim_Now() / 1e9);
+	printf("host time            %.3f s\n", hostSeconds);
+	printf("bytes read           %llu\n", (unsigned long long)stats->bytesRead);
+	printf("bytes programmed     %llu\n", (unsigned long long)stats->bytesProgrammed);
+	printf("page programs        %u\n", stats->pagePrograms);
+	printf("erases 4K/32K/64K    %u/%u/%u\n", stats->sectorErases, stats->block32kErases, stats->block64kErases);
+	printf("security reg erases  %u, programs %u\n", stats->securityErases, stats->securityPrograms);
+	printf("ignored commands     %u\n", stats->ignoredCommands);
+	printf("program conflicts    %u\n", stats->programConflicts);
+	printf("sectors erased       %u of %u, max %u erases, %llu total\n",
+		   worn, W25QSIM_SECTOR_COUNT, highest, (unsigned long long)total);
+}
+
+int main(int argc, char **argv)
+{
+	static uint32_t eraseCountArray[TOTAL_BLOCKS];
+	static uint8_t blockMapArray[TOTAL_BLOCKS];
+	static uint8_t data[W25Q_BlockSize];
+	const char *image = NULL;
+	uint32_t writes = 100;
+	uint32_t block = 5;
+	uint32_t length = 4096;
+	struct timespec start;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(i + 1 < argc && strcmp(argv[i], "-i") == 0)
+		{
+			image = argv[++i];
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-n") == 0)
+		{
+			writes = strtoul(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-b") == 0)
+		{
+			block = strtoul(argv[++i], NULL, 0) % TOTAL_BLOCKS;
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-l") == 0)
+		{
+			length = strtoul(argv[++i], NULL, 0);
+			length = (length > sizeof(data)) ? sizeof(data) : length;
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+		{
+			SFS_SetSwapThreshold(strtoul(argv[++i], NULL, 0));
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-i image] [-n writes] [-b block] [-l length] [-s swap-threshold]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if(W25QSim_Open(image) != 0)
+	{
+		return 1;
+	}
+	for(uint32_t i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i * 31;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	W25Q_Init();
+	SFS_InitFS();
+	SFS_ReadFS(eraseCountArray, blockMapArray);
+	for(uint32_t i = 0; i < writes; i++)
+	{
+		SFS_WriteData(eraseCountArray, blockMapArray, block, data, length);
+	}
+	SimRun_Report(writes, SimRun_Seconds(&start));
+	W25QSim_Close();
+	return 0;
+}
@@ -0,0 +1,85 @@
+#include "SYSTICK.h"
+#include "SimTick.h"
+#include "W25QSim.h"
+
+#define NS_PER_MS	1000000ULL
+
+static tick_hook_t tickHook;
+
+static uint64_t SimTick_CyclesNs(uint64_t cycles)
+{
+	return (cycles * 1000000000ULL) / SIMTICK_HCLK_HZ;
+}
+
+/**
+ * @brief	Stands in for __WFI(): the next event is the next tick interrupt
+ */
+void SimTick_Idle(void)
+{
+	uint64_t now = W25QSim_Now();
+
+	W25QSim_Advance(NS_PER_MS - (now % NS_PER_MS));
+	if(tickHook != NULL)
+	{
+		tickHook();
+	}
+}
+
+void tick_init(void)
+{
+}
+
+uint32_t get_ticks(void)
+{
+	return W25QSim_Now() / NS_PER_MS;
+}
+
+uint32_t get_micros(void)
+{
+	return W25QSim_Now() / 1000;
+}
+
+uint32_t deadline_after(uint32_t ms)
+{
+	return get_ticks() + ms + 1;
+}
+
+uint8_t deadline_expired(uint32_t deadline)
+{
+	return ((int32_t)(get_ticks() - deadline) >= 0);
+}
+
+void sleep_until(uint32_t deadline)
+{
+	while(!deadline_expired(deadline))
+	{
+		SimTick_Idle();
+	}
+}
+
+// The hook runs from SimTick_Idle(), ticks skipped by busy code do not call it
+void tick_set_hook(tick_hook_t hook)
+{
+	tickHook = hook;
+}
+
+void delay_ms(uint32_t ms)
+{
+	sleep_until(deadline_after(ms));
+}
+
+void cycle_counter_init(void)
+{
+}
+
+uint32_t cycle_count(void)
+{
+	// Spinning on the counter must let virtual time pass
+	W25QSim_Advance(SIMTICK_POLL_NS);
+	return (W25QSim_Now() * SIMTICK_HCLK_HZ) / 1000000000ULL;
+}
+
+uint32_t cycles_to_us(uint32_t cycles)
+{
+	return SimTick_CyclesNs(cycles) / 1000;
+}
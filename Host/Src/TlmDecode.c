@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "TlmStream.h"
+
+/* Decodes the telemetry stream of the board (a capture file or the serial
+ * device), prints every event and rebuilds the erase count and block map
+ * tables. Usage: tlm_decode [-q] [-c table.csv] [capture]
+ *	-q	only print the final tables
+ *	-c	also export the final tables as CSV */
+
+static void TlmDecode_PrintTables(const TlmState *state)
+{
+	uint16_t blockCount = state->blockCount ? state->blockCount : 128;
+
+	printf("\nErase count:\n");
+	for(uint16_t i = 0; i < blockCount; i++)
+	{
+		printf("%7u%s", state->eraseCount[i], ((i % 8) == 7) ? "\n" : "");
+	}
+	printf("\nBlock map:\n");
+	for(uint16_t i = 0; i < blockCount; i++)
+	{
+		printf("%7u%s", state->blockMap[i], ((i % 8) == 7) ? "\n" : "");
+	}
+	printf("\n%u records, %u lost, %u bad frames\n", state->records, state->lostRecords, state->badFrames);
+}
+
+static int TlmDecode_ExportCsv(const TlmState *state, const char *path)
+{
+	uint16_t blockCount = state->blockCount ? state->blockCount : 128;
+	FILE *csv = fopen(path, "w");
+
+	if(csv == NULL)
+	{
+		perror(path);
+		return 1;
+	}
+	fprintf(csv, "block,erase_count,mapped_block\n");
+	for(uint16_t i = 0; i < blockCount; i++)
+	{
+		fprintf(csv, "%u,%u,%u\n", i, state->eraseCount[i], state->blockMap[i]);
+	}
+	fclose(csv);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static TlmState state;
+	const char *csvPath = NULL;
+	FILE *input = stdin;
+	uint8_t byte;
+	int c;
+
+	state.verbose = 1;
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-q") == 0)
+		{
+			state.verbose = 0;
+		}
+		else if(strcmp(argv[i], "-c") == 0 && (i + 1) < argc)
+		{
+			csvPath = argv[++i];
+		}
+		else if(input == stdin)
+		{
+			input = fopen(argv[i], "rb");
+			if(input == NULL)
+			{
+				perror(argv[i]);
+				return 1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-q] [-c table.csv] [capture]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	while((c = fgetc(input)) != EOF)
+	{
+		byte = c;
+		TlmStream_Feed(&state, &byte, 1);
+	}
+	if(input != stdin)
+	{
+		fclose(input);
+	}
+
+	TlmDecode_PrintTables(&state);
+	return (csvPath != NULL) ? TlmDecode_ExportCsv(&state, csvPath) : 0;
+}
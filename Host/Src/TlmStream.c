@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include "TlmStream.h"
+#include "CRC.h"
+
+static uint32_t TlmStream_U16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t TlmStream_U32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Payload length of each event, snapshots are checked separately
+static int TlmStream_PayloadOk(uint8_t type, const uint8_t *payload, uint32_t length)
+{
+	switch(type)
+	{
+		case TLM_EVENT_MOUNT:		return length == 6;
+		case TLM_EVENT_WRITE:		return length == 6;
+		case TLM_EVENT_REMAP:		return length == 2;
+		case TLM_EVENT_ERASE_COUNT:	return length == 5;
+		case TLM_EVENT_SNAPSHOT:	return length >= 2 && length == 2 + (payload[1] * 5u);
+		default :					return 0;
+	}
+}
+
+static void TlmStream_Record(TlmState *state, const uint8_t *record, uint32_t length)
+{
+	uint8_t type = record[0];
+	uint8_t sequence = record[1];
+	uint32_t timestamp = TlmStream_U32(&record[2]);
+	const uint8_t *payload = &record[TLM_HEADER_SIZE];
+	uint32_t payloadLength = length - TLM_HEADER_SIZE - TLM_CRC_SIZE;
+	uint8_t first;
+
+	if(!TlmStream_PayloadOk(type, payload, payloadLength))
+	{
+		state->badFrames++;
+		return;
+	}
+	if(state->synced && sequence != state->nextSequence)
+	{
+		state->lostRecords += (uint8_t)(sequence - state->nextSequence);
+	}
+	state->nextSequence = sequence + 1;
+	state->synced = 1;
+	state->records++;
+
+	switch(type)
+	{
+		case TLM_EVENT_MOUNT:
+			state->blockCount = TlmStream_U16(payload);
+			state->blockSize = TlmStream_U32(&payload[2]);
+			if(state->verbose)
+			{
+				printf("%10u mount     blocks=%u blockSize=%u\n", timestamp, state->blockCount, state->blockSize);
+			}
+			break;
+		case TLM_EVENT_WRITE:
+			if(state->verbose)
+			{
+				printf("%10u write     logical=%u physical=%u length=%u\n", timestamp,
+					   payload[0], payload[1], TlmStream_U32(&payload[2]));
+			}
+			break;
+		case TLM_EVENT_REMAP:
+			state->blockMap[payload[0]] = payload[1];
+			if(state->verbose)
+			{
+				printf("%10u remap     logical=%u -> physical=%u\n", timestamp, payload[0], payload[1]);
+			}
+			break;
+		case TLM_EVENT_ERASE_COUNT:
+			state->eraseCount[payload[0]] = TlmStream_U32(&payload[1]);
+			if(state->verbose)
+			{
+				printf("%10u erase     block=%u count=%u\n", timestamp, payload[0], state->eraseCount[payload[0]]);
+			}
+			break;
+		case TLM_EVENT_SNAPSHOT:
+			first = payload[0];
+			for(uint32_t i = 0; i < payload[1] && (first + i) < TLM_STREAM_MAX_BLOCKS; i++)
+			{
+				state->eraseCount[first + i] = TlmStream_U32(&payload[2 + (i * 5)]);
+				state->blockMap[first + i] = payload[6 + (i * 5)];
+			}
+			if(state->verbose)
+			{
+				printf("%10u snapshot  blocks %u..%u\n", timestamp, first, first + payload[1] - 1);
+			}
+			break;
+		default :
+			break;
+	}
+}
+
+/**
+ * @brief	Decodes and checks one frame, without its 0x00 delimiters, and
+ * 			applies the record to the tables
+ */
+void TlmStream_Frame(TlmState *state, const uint8_t *frame, uint32_t length)
+{
+	uint8_t record[COBS_MAX_ENCODED(TLM_MAX_RECORD)];
+	uint32_t recordLength;
+
+	if(length == 0 || length > sizeof(record))
+	{
+		state->badFrames += (length != 0);
+		return;
+	}
+	recordLength = COBS_Decode(frame, length, record);
+	if(recordLength < TLM_HEADER_SIZE + TLM_CRC_SIZE || recordLength > TLM_MAX_RECORD ||
+	   CRC16_Update(CRC16_INIT, record, recordLength - TLM_CRC_SIZE) !=
+	   TlmStream_U16(&record[recordLength - TLM_CRC_SIZE]))
+	{
+		state->badFrames++;
+		return;
+	}
+	TlmStream_Record(state, record, recordLength);
+}
+
+/**
+ * @brief	Adds received bytes, every 0x00 ends a frame. Text or noise in
+ * 			between frames fails the CRC and is counted as a bad frame.
+ */
+void TlmStream_Feed(TlmState *state, const uint8_t *data, uint32_t length)
+{
+	for(uint32_t i = 0; i < length; i++)
+	{
+		if(data[i] == 0x00)
+		{
+			if(state->overflow)
+			{
+				state->badFrames++;
+			}
+			else
+			{
+				TlmStream_Frame(state, state->frame, state->frameLength);
+			}
+			state->frameLength = 0;
+			state->overflow = 0;
+		}
+		else if(state->frameLength < sizeof(state->frame))
+		{
+			state->frame[state->frameLength++] = data[i];
+		}
+		else
+		{
+			state->overflow = 1;
+		}
+	}
+}
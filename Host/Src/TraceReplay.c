@@ -0,0 +1,348 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "W25Qxx.h"
+#include "SWAP_FS.h"
+#include "TRACE.h"
+#include "COBS.h"
+#include "CRC.h"
+#include "W25QSim.h"
+
+/* Replays an access trace recorded on the board (trace stream or trace dump
+ * captured from the serial port) through SFS_WriteData() on a fresh
+ * simulated chip, so allocation policies can be tuned against production
+ * traffic. Only the SFS writes are replayed, the driver records they caused
+ * are regenerated by the replay, and all driver records are summarized.
+ * Usage: trace_replay [-t] [-x speed] [-s swap-threshold] [-v] [capture]
+ *	-t	keep the recorded gaps between writes on the simulator clock,
+ *		scaled by -x, instead of issuing the writes back to back
+ *	-v	print every record */
+
+#define BLOCK_SECTORS		(W25Q_BlockSize / W25Q_SectorSize)
+
+typedef struct
+{
+	uint8_t op;
+	uint8_t logicalBlock;
+	uint8_t physicalBlock;
+	uint64_t timeUs;		// Unwrapped, from the first record
+	uint32_t address;
+	uint32_t length;
+} TraceEntry;
+
+typedef struct
+{
+	TraceEntry *entries;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t badFrames;
+	uint32_t lostRecords;
+	uint8_t nextSequence;
+	uint32_t lastTimestamp;
+	uint8_t synced;
+	// Recorded driver traffic, indexed by TRACE_Op
+	uint32_t opCount[TRACE_OP_SECURITY_ERASE + 1];
+	uint64_t opBytes[TRACE_OP_SECURITY_ERASE + 1];
+} TraceLog;
+
+static const char *opNames[TRACE_OP_SECURITY_ERASE + 1] =
+{
+	"?", "write", "read", "program", "erase", "sec erase"
+};
+
+static uint32_t TraceReplay_U16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t TraceReplay_U32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void TraceReplay_Record(TraceLog *log, const uint8_t *record, int verbose)
+{
+	uint8_t op = record[0];
+	uint8_t sequence = record[1];
+	uint32_t timestamp = TraceReplay_U32(&record[4]);
+	TraceEntry *entry;
+
+	if(op < TRACE_OP_WRITE || op > TRACE_OP_SECURITY_ERASE)
+	{
+		log->badFrames++;
+		return;
+	}
+	if(log->count == log->capacity)
+	{
+		uint32_t capacity = log->capacity ? log->capacity * 2 : 4096;
+		TraceEntry *entries = realloc(log->entries, capacity * sizeof(TraceEntry));
+
+		if(entries == NULL)
+		{
+			log->badFrames++;
+			return;
+		}
+		log->entries = entries;
+		log->capacity = capacity;
+	}
+	if(log->synced && sequence != log->nextSequence)
+	{
+		log->lostRecords += (uint8_t)(sequence - log->nextSequence);
+	}
+
+	entry = &log->entries[log->count];
+	entry->op = op;
+	entry->logicalBlock = record[2];
+	entry->physicalBlock = record[3];
+	// The microsecond counter wraps every 71 minutes, records are far closer together
+	entry->timeUs = log->synced ? log->entries[log->count - 1].timeUs + (uint32_t)(timestamp - log->lastTimestamp) : 0;
+	entry->address = TraceReplay_U32(&record[8]);
+	entry->length = TraceReplay_U32(&record[12]);
+	log->count++;
+	log->nextSequence = sequence + 1;
+	log->lastTimestamp = timestamp;
+	log->synced = 1;
+	log->opCount[op]++;
+	log->opBytes[op] += entry->length;
+
+	if(verbose)
+	{
+		printf("%12llu %-9s logical=%3u physical=%3u address=0x%06x length=%u\n",
+			   (unsigned long long)entry->timeUs, opNames[op], entry->logicalBlock,
+			   entry->physicalBlock, entry->address, entry->length);
+	}
+}
+
+static void TraceReplay_Frame(TraceLog *log, const uint8_t *frame, uint32_t length, int verbose)
+{
+	uint8_t record[COBS_MAX_ENCODED(TRACE_RECORD_SIZE + TRACE_CRC_SIZE)];
+	uint32_t recordLength;
+
+	if(length == 0 || length > sizeof(record))
+	{
+		log->badFrames += (length != 0);
+		return;
+	}
+	recordLength = COBS_Decode(frame, length, record);
+	if(recordLength != TRACE_RECORD_SIZE + TRACE_CRC_SIZE ||
+	   CRC16_Update(CRC16_INIT, record, TRACE_RECORD_SIZE) != TraceReplay_U16(&record[TRACE_RECORD_SIZE]))
+	{
+		log->badFrames++;
+		return;
+	}
+	TraceReplay_Record(log, record, verbose);
+}
+
+// Frames end at 0x00, text or noise in between fails the CRC and is skipped
+static void TraceReplay_Load(TraceLog *log, FILE *input, int verbose)
+{
+	uint8_t frame[COBS_MAX_ENCODED(TRACE_RECORD_SIZE + TRACE_CRC_SIZE) + 1];
+	uint32_t frameLength = 0;
+	uint8_t overflow = 0;
+	int c;
+
+	while((c = fgetc(input)) != EOF)
+	{
+		if(c == 0x00)
+		{
+			if(overflow)
+			{
+				log->badFrames++;
+			}
+			else
+			{
+				TraceReplay_Frame(log, frame, frameLength, verbose);
+			}
+			frameLength = 0;
+			overflow = 0;
+		}
+		else if(frameLength < sizeof(frame))
+		{
+			frame[frameLength++] = c;
+		}
+		else
+		{
+			overflow = 1;
+		}
+	}
+}
+
+static void TraceReplay_PrintWear(void)
+{
+	uint32_t wear[TOTAL_BLOCKS];
+	uint32_t lowest = UINT32_MAX;
+	uint32_t highest = 0;
+	double mean = 0;
+	double squares = 0;
+
+	// A block is as worn as its most erased sector
+	for(uint32_t block = 0; block < TOTAL_BLOCKS; block++)
+	{
+		wear[block] = 0;
+		for(uint32_t sector = 0; sector < BLOCK_SECTORS; sector++)
+		{
+			uint32_t count = W25QSim_SectorEraseCount((block * BLOCK_SECTORS) + sector);
+
+			wear[block] = (count > wear[block]) ? count : wear[block];
+		}
+		lowest = (wear[block] < lowest) ? wear[block] : lowest;
+		highest = (wear[block] > highest) ? wear[block] : highest;
+		mean += wear[block];
+	}
+	mean /= TOTAL_BLOCKS;
+	for(uint32_t block = 0; block < TOTAL_BLOCKS; block++)
+	{
+		squares += (wear[block] - mean) * (wear[block] - mean);
+	}
+	printf("block wear           mean %.2f, sd %.2f, min %u, max %u, spread %u\n",
+		   mean, sqrt(squares / TOTAL_BLOCKS), lowest, highest, highest - lowest);
+}
+
+/**
+ * @brief	Feeds the recorded SFS writes to a fresh simulated chip
+ * @param	timed	1 to start each write no earlier than its recorded time
+ * @param	speed	Recorded time is divided by this in timed mode
+ * @return	0 on success, -1 if the simulator could not start
+ */
+static int TraceReplay_Run(const TraceLog *log, int timed, double speed)
+{
+	static uint32_t eraseCountArray[TOTAL_BLOCKS];
+	static uint8_t blockMapArray[TOTAL_BLOCKS];
+	static uint8_t data[W25Q_BlockSize];
+	const W25QSim_Stats *stats;
+	uint32_t writes = 0;
+	uint32_t diverged = 0;
+	uint32_t late = 0;
+	uint64_t maxLagNs = 0;
+	uint64_t startNs;
+	struct timespec start, end;
+
+	if(W25QSim_Open(NULL) != 0)
+	{
+		return -1;
+	}
+	for(uint32_t i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i * 31;
+	}
+	W25Q_Init();
+	SFS_Format(eraseCountArray, blockMapArray);
+	W25QSim_ResetStats();
+	startNs = W25QSim_Now();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < log->count; i++)
+	{
+		const TraceEntry *entry = &log->entries[i];
+		uint32_t length = (entry->length > W25Q_BlockSize) ? W25Q_BlockSize : entry->length;
+
+		if(entry->op != TRACE_OP_WRITE || entry->logicalBlock >= TOTAL_BLOCKS)
+		{
+			continue;
+		}
+		if(timed)
+		{
+			uint64_t dueNs = startNs + (uint64_t)((entry->timeUs * 1000.0) / speed);
+			uint64_t nowNs = W25QSim_Now();
+
+			if(nowNs < dueNs)
+			{
+				W25QSim_Advance(dueNs - nowNs);
+			}
+			else if(nowNs > dueNs)
+			{
+				late++;
+				maxLagNs = (nowNs - dueNs > maxLagNs) ? nowNs - dueNs : maxLagNs;
+			}
+		}
+		// The block choice only reads the tables, so asking first does not change it
+		diverged += (SFS_SelectBlock(eraseCountArray, entry->logicalBlock) != entry->physicalBlock);
+		SFS_WriteData(eraseCountArray, blockMapArray, entry->logicalBlock, data, length);
+		writes++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	stats = W25QSim_GetStats();
+	printf("replayed writes      %u, %u placed differently than recorded\n", writes, diverged);
+	printf("simulated time       %.3f s\n", (W25QSim_Now() - startNs) / 1e9);
+	printf("host time            %.3f s\n",
+		   (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9));
+	if(timed)
+	{
+		printf("late writes          %u, worst %.3f ms behind\n", late, maxLagNs / 1e6);
+	}
+	printf("bytes programmed     %llu\n", (unsigned long long)stats->bytesProgrammed);
+	printf("erases 4K/32K/64K    %u/%u/%u\n", stats->sectorErases, stats->block32kErases, stats->block64kErases);
+	printf("security reg erases  %u\n", stats->securityErases);
+	TraceReplay_PrintWear();
+	W25QSim_Close();
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static TraceLog log;
+	FILE *input = stdin;
+	int timed = 0;
+	int verbose = 0;
+	double speed = 1.0;
+	int result;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-t") == 0)
+		{
+			timed = 1;
+		}
+		else if(strcmp(argv[i], "-v") == 0)
+		{
+			verbose = 1;
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-x") == 0)
+		{
+			speed = strtod(argv[++i], NULL);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+		{
+			SFS_SetSwapThreshold(strtoul(argv[++i], NULL, 0));
+		}
+		else if(input == stdin && argv[i][0] != '-')
+		{
+			input = fopen(argv[i], "rb");
+			if(input == NULL)
+			{
+				perror(argv[i]);
+				return 1;
+			}
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-t] [-x speed] [-s swap-threshold] [-v] [capture]\n", argv[0]);
+			return 1;
+		}
+	}
+	if(speed <= 0)
+	{
+		fprintf(stderr, "speed must be above 0\n");
+		return 1;
+	}
+
+	TraceReplay_Load(&log, input, verbose);
+	if(input != stdin)
+	{
+		fclose(input);
+	}
+
+	printf("%u records, %u lost, %u bad frames, %.3f s recorded\n", log.count, log.lostRecords,
+		   log.badFrames, log.count ? log.entries[log.count - 1].timeUs / 1e6 : 0.0);
+	for(uint32_t op = TRACE_OP_WRITE; op <= TRACE_OP_SECURITY_ERASE; op++)
+	{
+		printf("recorded %-11s %8u, %llu bytes\n", opNames[op], log.opCount[op],
+			   (unsigned long long)log.opBytes[op]);
+	}
+	result = TraceReplay_Run(&log, timed, speed);
+	free(log.entries);
+	return (result == 0) ? 0 : 1;
+}
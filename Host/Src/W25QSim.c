@@ -0,0 +1,622 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "W25QSim.h"
+#include "W25Qxx.h"
+
+#define ERASE_CHIP_ALT		0xC7
+
+#define SR1_WRITE_MASK		0xFC
+#define SR2_WRITE_MASK		0x7B
+
+#define NS_PER_US			1000ULL
+#define NS_PER_MS			1000000ULL
+
+static const W25QSim_Timing defaultTiming =
+{
+	.pageProgramNs = 700 * NS_PER_US,
+	.sectorEraseNs = 45 * NS_PER_MS,
+	.block32kEraseNs = 120 * NS_PER_MS,
+	.block64kEraseNs = 150 * NS_PER_MS,
+	.chipEraseNs = 20000 * NS_PER_MS,
+	.statusWriteNs = 10 * NS_PER_MS,
+	.suspendNs = 20 * NS_PER_US
+};
+
+// JESD216 header and basic flash parameter table of the W25Q64FV
+static const uint8_t sfdpHeader[16] =
+{
+	'S', 'F', 'D', 'P', 0x00, 0x01, 0x00, 0xFF,
+	0x00, 0x00, 0x01, 0x09, 0x80, 0x00, 0x00, 0xFF
+};
+#define SFDP_TABLE_ADDRESS	0x80
+static const uint32_t sfdpTable[9] =
+{
+	0xFFF920E5, 0x03FFFFFF, 0x6B08EB44, 0xBB423B08, 0xFFFFFFFE,
+	0xFF00FFFF, 0xEB40FFFF, 0x520F200C, 0xFF00D810
+};
+
+static const uint8_t uniqueId[8] = {0xD2, 0x63, 0x5C, 0x48, 0x17, 0x2A, 0x33, 0x01};
+
+// Operation the chip is busy with, kept so it can be suspended
+typedef enum
+{
+	SIM_OP_NONE = 0,
+	SIM_OP_PROGRAM,
+	SIM_OP_ERASE,
+	SIM_OP_STATUS
+} SimOperation;
+
+typedef struct
+{
+	uint8_t *image;
+	uint8_t *array;
+	uint8_t *security;
+	uint32_t *eraseCounts;
+	int fd;
+
+	W25QSim_Timing timing;
+	W25QSim_Stats stats;
+	uint64_t now;
+
+	uint8_t status1;
+	uint8_t status2;
+	uint8_t status3;
+	SimOperation operation;
+	uint64_t busyUntil;
+	uint64_t suspendedRemaining;
+	uint8_t poweredDown;
+	uint8_t resetEnabled;
+
+	// Current transaction
+	uint8_t selected;
+	uint8_t opcode;
+	uint32_t index;
+	uint32_t address;
+	uint8_t latch[W25QSIM_PAGE_SIZE];
+	uint8_t latchUsed[W25QSIM_PAGE_SIZE];
+	uint8_t statusData[2];
+	uint8_t ignored;
+} SimChip;
+
+static SimChip chips[W25QSIM_MAX_CHIPS] = { [0 ... W25QSIM_MAX_CHIPS - 1] = { .fd = -1 } };
+// Chip the bus functions talk to, see W25QSim_SelectChip()
+static SimChip *chip = &chips[0];
+// All chips share the virtual clock
+static uint64_t simNow;
+
+static uint8_t W25QSim_AddressBytes(void)
+{
+	return (chip->status3 & SR3_ADS) ? 4 : 3;
+}
+
+// Lets a finished operation drop BUSY and WEL
+static void W25QSim_Update(void)
+{
+	if((chip->status1 & SR1_BUSY) && simNow >= chip->busyUntil)
+	{
+		chip->status1 &= ~(SR1_BUSY | SR1_WEL);
+		chip->operation = SIM_OP_NONE;
+	}
+}
+
+static void W25QSim_StartBusy(SimOperation operation, uint64_t duration)
+{
+	chip->operation = operation;
+	chip->status1 |= SR1_BUSY;
+	chip->busyUntil = simNow + duration;
+}
+
+static uint8_t W25QSim_HasAddress(void)
+{
+	return chip->index > W25QSim_AddressBytes();
+}
+
+static uint8_t *W25QSim_SecurityRegister(uint32_t address)
+{
+	uint32_t reg = (address >> 12) & 0x0F;
+
+	if((address & 0xFFFF0F00) != 0 || reg < 1 || reg > W25QSIM_SECURITY_REGS)
+	{
+		return NULL;
+	}
+	return &chip->security[(reg - 1) * W25QSIM_SECURITY_SIZE];
+}
+
+// Programming can only clear bits, a 1 over a 0 stays 0
+static void W25QSim_ProgramByte(uint8_t *cell, uint8_t data)
+{
+	if((*cell & data) != data)
+	{
+		chip->stats.programConflicts++;
+	}
+	*cell &= data;
+	chip->stats.bytesProgrammed++;
+}
+
+static void W25QSim_Erase(uint32_t address, uint32_t size)
+{
+	address &= ~(size - 1) & (W25QSIM_BYTE_COUNT - 1);
+	memset(&chip->array[address], 0xFF, size);
+	for(uint32_t sector = address / W25QSIM_SECTOR_SIZE; sector < (address + size) / W25QSIM_SECTOR_SIZE; sector++)
+	{
+		chip->eraseCounts[sector]++;
+	}
+}
+
+/**
+ * @brief	Carries out a program, erase or register write when CS rises
+ */
+static void W25QSim_Execute(void)
+{
+	uint8_t *reg;
+
+	switch(chip->opcode)
+	{
+		case ENABLE_WRITE:
+			chip->status1 |= SR1_WEL;
+			break;
+		case DISABLE_WRITE:
+			chip->status1 &= ~SR1_WEL;
+			break;
+		case ENABLE_RESET:
+			chip->resetEnabled = 1;
+			return;
+		case EXECUTE_RESET:
+			if(chip->resetEnabled)
+			{
+				chip->status1 &= ~(SR1_BUSY | SR1_WEL);
+				chip->status2 &= ~SR2_SUS;
+				chip->status3 &= ~SR3_ADS;
+				chip->operation = SIM_OP_NONE;
+			}
+			break;
+		case POWER_DOWN:
+			chip->poweredDown = 1;
+			break;
+		case POWER_UP:
+			chip->poweredDown = 0;
+			break;
+		case WRITE_STATUS_REG:
+			if(chip->index < 2)
+			{
+				break;
+			}
+			chip->status1 = (chip->status1 & ~SR1_WRITE_MASK) | (chip->statusData[0] & SR1_WRITE_MASK);
+			if(chip->index > 2)
+			{
+				chip->status2 = (chip->status2 & ~SR2_WRITE_MASK) | (chip->statusData[1] & SR2_WRITE_MASK);
+			}
+			W25QSim_StartBusy(SIM_OP_STATUS, chip->timing.statusWriteNs);
+			break;
+		case PAGE_WRITE:
+			if(!W25QSim_HasAddress())
+			{
+				break;
+			}
+			for(uint32_t i = 0; i < W25QSIM_PAGE_SIZE; i++)
+			{
+				if(chip->latchUsed[i])
+				{
+					W25QSim_ProgramByte(&chip->array[(chip->address & ~(W25QSIM_PAGE_SIZE - 1)) + i], chip->latch[i]);
+				}
+			}
+			chip->stats.pagePrograms++;
+			W25QSim_StartBusy(SIM_OP_PROGRAM, chip->timing.pageProgramNs);
+			break;
+		case WRITE_SECURITY_REG:
+			reg = W25QSim_SecurityRegister(chip->address);
+			if(!W25QSim_HasAddress() || reg == NULL)
+			{
+				break;
+			}
+			for(uint32_t i = 0; i < W25QSIM_SECURITY_SIZE; i++)
+			{
+				if(chip->latchUsed[i])
+				{
+					W25QSim_ProgramByte(&reg[i], chip->latch[i]);
+				}
+			}
+			chip->stats.securityPrograms++;
+			W25QSim_StartBusy(SIM_OP_PROGRAM, chip->timing.pageProgramNs);
+			break;
+		case ERASE_SECTOR:
+			if(!W25QSim_HasAddress())
+			{
+				break;
+			}
+			W25QSim_Erase(chip->address, W25QSIM_SECTOR_SIZE);
+			chip->stats.sectorErases++;
+			W25QSim_StartBusy(SIM_OP_ERASE, chip->timing.sectorEraseNs);
+			break;
+		case ERASE_32KBLOCK:
+			if(!W25QSim_HasAddress())
+			{
+				break;
+			}
+			W25QSim_Erase(chip->address, 32768);
+			chip->stats.block32kErases++;
+			W25QSim_StartBusy(SIM_OP_ERASE, chip->timing.block32kEraseNs);
+			break;
+		case ERASE_64KBLOCK:
+			if(!W25QSim_HasAddress())
+			{
+				break;
+			}
+			W25QSim_Erase(chip->address, 65536);
+			chip->stats.block64kErases++;
+			W25QSim_StartBusy(SIM_OP_ERASE, chip->timing.block64kEraseNs);
+			break;
+		case ERASE_CHIP:
+		case ERASE_CHIP_ALT:
+			W25QSim_Erase(0, W25QSIM_BYTE_COUNT);
+			chip->stats.chipErases++;
+			W25QSim_StartBusy(SIM_OP_ERASE, chip->timing.chipEraseNs);
+			break;
+		case ERASE_SECURITY_REG:
+			reg = W25QSim_SecurityRegister(chip->address);
+			if(!W25QSim_HasAddress() || reg == NULL)
+			{
+				break;
+			}
+			memset(reg, 0xFF, W25QSIM_SECURITY_SIZE);
+			chip->stats.securityErases++;
+			W25QSim_StartBusy(SIM_OP_ERASE, chip->timing.sectorEraseNs);
+			break;
+		case SUSPEND:
+			if((chip->status1 & SR1_BUSY) && chip->operation != SIM_OP_STATUS)
+			{
+				chip->suspendedRemaining = chip->busyUntil - simNow;
+				chip->status1 &= ~SR1_BUSY;
+				chip->status2 |= SR2_SUS;
+				chip->stats.suspends++;
+				// tSUS: the suspend itself takes a moment before reads are served
+				simNow += chip->timing.suspendNs;
+			}
+			break;
+		case RESUME:
+			if(chip->status2 & SR2_SUS)
+			{
+				chip->status2 &= ~SR2_SUS;
+				W25QSim_StartBusy(chip->operation, chip->suspendedRemaining);
+			}
+			break;
+		default :
+			break;
+	}
+	chip->resetEnabled = 0;
+}
+
+// Commands a busy or suspended chip still accepts
+static uint8_t W25QSim_Accepts(uint8_t opcode)
+{
+	uint8_t writes;
+
+	if(chip->poweredDown)
+	{
+		return opcode == POWER_UP;
+	}
+	if(opcode == READ_STATUS_R1 || opcode == READ_STATUS_R2 || opcode == READ_STATUS_R3)
+	{
+		return 1;
+	}
+	if(chip->status1 & SR1_BUSY)
+	{
+		return opcode == SUSPEND;
+	}
+	writes = (opcode == PAGE_WRITE || opcode == WRITE_SECURITY_REG || opcode == WRITE_STATUS_REG ||
+			  opcode == ERASE_SECTOR || opcode == ERASE_32KBLOCK || opcode == ERASE_64KBLOCK ||
+			  opcode == ERASE_CHIP || opcode == ERASE_CHIP_ALT || opcode == ERASE_SECURITY_REG);
+	if(writes && ((chip->status2 & SR2_SUS) || !(chip->status1 & SR1_WEL)))
+	{
+		return 0;
+	}
+	// The W25Q64FV has no 4-byte address mode
+	return opcode != ENTER_4BYTE_MODE;
+}
+
+// Byte after the address (and dummy bytes) of a read, 0-based
+static int32_t W25QSim_DataIndex(uint8_t dummyBytes)
+{
+	return (int32_t)chip->index - 1 - W25QSim_AddressBytes() - dummyBytes;
+}
+
+static uint8_t W25QSim_ReadSfdp(uint32_t address)
+{
+	if(address < sizeof(sfdpHeader))
+	{
+		return sfdpHeader[address];
+	}
+	if(address >= SFDP_TABLE_ADDRESS && address < SFDP_TABLE_ADDRESS + sizeof(sfdpTable))
+	{
+		address -= SFDP_TABLE_ADDRESS;
+		return sfdpTable[address / 4] >> ((address % 4) * 8);
+	}
+	return 0xFF;
+}
+
+/**
+ * @brief	Clocks one byte through the chip
+ * @param	mosi	Byte driven by the master
+ * @return	Byte the chip drives back, 0xFF while it is not talking
+ */
+uint8_t W25QSim_Transfer(uint8_t mosi)
+{
+	uint8_t miso = 0xFF;
+	int32_t data;
+	uint8_t *reg;
+
+	if(!chip->selected)
+	{
+		return miso;
+	}
+	W25QSim_Update();
+	if(chip->index == 0)
+	{
+		chip->opcode = mosi;
+		chip->ignored = !W25QSim_Accepts(mosi);
+		chip->address = 0;
+		memset(chip->latchUsed, 0, sizeof(chip->latchUsed));
+		if(chip->ignored)
+		{
+			chip->stats.ignoredCommands++;
+		}
+		chip->index++;
+		return miso;
+	}
+	if(chip->ignored)
+	{
+		chip->index++;
+		return miso;
+	}
+
+	// Address bytes, SFDP always takes three
+	if(chip->opcode == READ_SFDP ? chip->index <= 3 : chip->index <= W25QSim_AddressBytes())
+	{
+		chip->address = (chip->address << 8) | mosi;
+	}
+
+	switch(chip->opcode)
+	{
+		case READ_STATUS_R1:
+			miso = chip->status1;
+			break;
+		case READ_STATUS_R2:
+			miso = chip->status2;
+			break;
+		case READ_STATUS_R3:
+			miso = chip->status3;
+			break;
+		case READ_ID:
+			if(chip->index <= 3)
+			{
+				miso = W25QSIM_JEDEC_ID >> ((3 - chip->index) * 8);
+			}
+			break;
+		case READ_UID:
+			// Four dummy bytes, then the 64-bit ID
+			if(chip->index >= 5 && chip->index <= 12)
+			{
+				miso = uniqueId[chip->index - 5];
+			}
+			break;
+		case POWER_UP:
+			// Three dummy bytes, then the device ID repeats
+			if(chip->index >= 4)
+			{
+				miso = W25QSIM_DEVICE_ID;
+			}
+			break;
+		case NORMAL_READ:
+		case FAST_READ:
+			data = W25QSim_DataIndex(chip->opcode == FAST_READ);
+			if(data >= 0)
+			{
+				miso = chip->array[(chip->address + data) & (W25QSIM_BYTE_COUNT - 1)];
+				chip->stats.bytesRead++;
+			}
+			break;
+		case READ_SFDP:
+			data = (int32_t)chip->index - 5;
+			if(data >= 0)
+			{
+				miso = W25QSim_ReadSfdp((chip->address + data) & 0xFFFFFF);
+			}
+			break;
+		case READ_SECURITY_REG:
+			data = W25QSim_DataIndex(1);
+			reg = W25QSim_SecurityRegister(chip->address);
+			if(data >= 0 && reg != NULL)
+			{
+				miso = reg[(chip->address + data) & (W25QSIM_SECURITY_SIZE - 1)];
+				chip->stats.bytesRead++;
+			}
+			break;
+		case PAGE_WRITE:
+		case WRITE_SECURITY_REG:
+			data = W25QSim_DataIndex(0);
+			if(data >= 0)
+			{
+				// Data past the end of the page wraps to its start
+				uint32_t column = (chip->address + data) & (W25QSIM_PAGE_SIZE - 1);
+
+				chip->latch[column] = mosi;
+				chip->latchUsed[column] = 1;
+			}
+			break;
+		case WRITE_STATUS_REG:
+			if(chip->index <= 2)
+			{
+				chip->statusData[chip->index - 1] = mosi;
+			}
+			break;
+		default :
+			break;
+	}
+	chip->index++;
+	return miso;
+}
+
+void W25QSim_Select(void)
+{
+	chip->selected = 1;
+	chip->index = 0;
+}
+
+void W25QSim_Deselect(void)
+{
+	if(!chip->selected)
+	{
+		return;
+	}
+	chip->selected = 0;
+	W25QSim_Update();
+	if(chip->index > 0 && !chip->ignored)
+	{
+		W25QSim_Execute();
+	}
+}
+
+static uint8_t W25QSim_OpenChips(void)
+{
+	uint8_t count = 0;
+
+	for(uint8_t i = 0; i < W25QSIM_MAX_CHIPS; i++)
+	{
+		count += (chips[i].image != NULL);
+	}
+	return count;
+}
+
+/**
+ * @brief	Maps the image file and powers the chip up
+ * @param	path	Image file, created blank if missing, NULL for a RAM-only chip
+ * @return	0 on success, -1 if the image could not be mapped
+ */
+int W25QSim_Open(const char *path)
+{
+	struct stat info;
+	uint8_t blank = 1;
+
+	W25QSim_Close();
+	if(path == NULL)
+	{
+		chip->image = mmap(NULL, W25QSIM_IMAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+	else
+	{
+		chip->fd = open(path, O_RDWR | O_CREAT, 0644);
+		if(chip->fd < 0 || fstat(chip->fd, &info) != 0)
+		{
+			perror(path);
+			W25QSim_Close();
+			return -1;
+		}
+		blank = (info.st_size == 0);
+		if(ftruncate(chip->fd, W25QSIM_IMAGE_SIZE) != 0)
+		{
+			perror(path);
+			W25QSim_Close();
+			return -1;
+		}
+		chip->image = mmap(NULL, W25QSIM_IMAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, chip->fd, 0);
+	}
+	if(chip->image == MAP_FAILED)
+	{
+		chip->image = NULL;
+		perror("mmap");
+		W25QSim_Close();
+		return -1;
+	}
+
+	chip->array = chip->image;
+	chip->security = chip->array + W25QSIM_BYTE_COUNT;
+	chip->eraseCounts = (uint32_t *)(chip->security + (W25QSIM_SECURITY_REGS * W25QSIM_SECURITY_SIZE));
+	// A new chip leaves the factory erased
+	if(blank)
+	{
+		memset(chip->array, 0xFF, W25QSIM_BYTE_COUNT + (W25QSIM_SECURITY_REGS * W25QSIM_SECURITY_SIZE));
+	}
+
+	// The clock restarts with the first chip, later ones join it
+	if(W25QSim_OpenChips() == 1)
+	{
+		simNow = 0;
+	}
+	chip->timing = defaultTiming;
+	memset(&chip->stats, 0, sizeof(chip->stats));
+	chip->status1 = 0;
+	chip->status2 = 0;
+	chip->status3 = 0;
+	chip->operation = SIM_OP_NONE;
+	chip->poweredDown = 0;
+	chip->resetEnabled = 0;
+	chip->selected = 0;
+	return 0;
+}
+
+void W25QSim_Close(void)
+{
+	if(chip->image != NULL)
+	{
+		if(chip->fd >= 0)
+		{
+			msync(chip->image, W25QSIM_IMAGE_SIZE, MS_SYNC);
+		}
+		munmap(chip->image, W25QSIM_IMAGE_SIZE);
+		chip->image = NULL;
+	}
+	if(chip->fd >= 0)
+	{
+		close(chip->fd);
+		chip->fd = -1;
+	}
+}
+
+/**
+ * @brief	Points the bus, open and inspection functions at another chip,
+ * 			as if a different chip select had been pulled low
+ * @param	index	0 to W25QSIM_MAX_CHIPS - 1, chip 0 is used until changed
+ */
+void W25QSim_SelectChip(uint8_t index)
+{
+	chip = &chips[index % W25QSIM_MAX_CHIPS];
+}
+
+uint64_t W25QSim_Now(void)
+{
+	return simNow;
+}
+
+void W25QSim_Advance(uint64_t ns)
+{
+	simNow += ns;
+}
+
+void W25QSim_SetTiming(const W25QSim_Timing *timing)
+{
+	chip->timing = (timing != NULL) ? *timing : defaultTiming;
+}
+
+const W25QSim_Stats *W25QSim_GetStats(void)
+{
+	return &chip->stats;
+}
+
+void W25QSim_ResetStats(void)
+{
+	memset(&chip->stats, 0, sizeof(chip->stats));
+}
+
+uint32_t W25QSim_SectorEraseCount(uint32_t sector)
+{
+	return (sector < W25QSIM_SECTOR_COUNT) ? chip->eraseCounts[sector] : 0;
+}
+
+const uint8_t *W25QSim_Array(void)
+{
+	return chip->array;
+}
@@ -0,0 +1,283 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "W25Qxx.h"
+#include "SWAP_FS.h"
+#include "W25QSim.h"
+#include "Workload.h"
+
+/* Wear-leveling benchmark: drives SFS_WriteData() on the simulated chip
+ * with standard access patterns and reports throughput, flash traffic and
+ * how evenly the erases were spread. Each workload starts on a fresh chip.
+ * Usage: wear_bench [-w workload] [-n writes] [-l length] [-s swap-threshold]
+ *                   [-r seed] [-c results.csv] [-j results.json]
+ *	-w	uniform, sequential, hotspot, zipf or bursty, all of them by default
+ * Erase statistics are per 64 KB block, taking the most erased sector of
+ * each block as its wear. */
+
+#define BLOCK_SECTORS		(W25Q_BlockSize / W25Q_SectorSize)
+
+typedef struct
+{
+	const char *workload;
+	uint32_t writes;
+	uint32_t length;
+	double hostSeconds;
+	double simSeconds;
+	uint64_t flashBytes;
+	uint64_t erasedBytes;
+	double writeAmplification;
+	double eraseMean;
+	double eraseStddev;
+	uint32_t eraseMin;
+	uint32_t eraseMax;
+} BenchResult;
+
+static double Bench_Seconds(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + ((end.tv_nsec - start->tv_nsec) / 1e9);
+}
+
+static void Bench_EraseStats(BenchResult *result)
+{
+	uint32_t wear[TOTAL_BLOCKS];
+	double sum = 0;
+	double squares = 0;
+
+	result->eraseMin = UINT32_MAX;
+	result->eraseMax = 0;
+	for(uint32_t block = 0; block < TOTAL_BLOCKS; block++)
+	{
+		wear[block] = 0;
+		for(uint32_t sector = 0; sector < BLOCK_SECTORS; sector++)
+		{
+			uint32_t count = W25QSim_SectorEraseCount((block * BLOCK_SECTORS) + sector);
+
+			wear[block] = (count > wear[block]) ? count : wear[block];
+		}
+		result->eraseMin = (wear[block] < result->eraseMin) ? wear[block] : result->eraseMin;
+		result->eraseMax = (wear[block] > result->eraseMax) ? wear[block] : result->eraseMax;
+		sum += wear[block];
+	}
+	result->eraseMean = sum / TOTAL_BLOCKS;
+	for(uint32_t block = 0; block < TOTAL_BLOCKS; block++)
+	{
+		squares += (wear[block] - result->eraseMean) * (wear[block] - result->eraseMean);
+	}
+	result->eraseStddev = sqrt(squares / TOTAL_BLOCKS);
+}
+
+/**
+ * @brief	Runs one workload on a fresh chip
+ * @return	0 on success, -1 if the simulator could not start
+ */
+static int Bench_Run(Workload workload, uint32_t writes, uint32_t length, uint64_t seed,
+					 const uint8_t *data, BenchResult *result)
+{
+	static uint32_t eraseCountArray[TOTAL_BLOCKS];
+	static uint8_t blockMapArray[TOTAL_BLOCKS];
+	const W25QSim_Stats *stats;
+	Workload_Source source;
+	struct timespec start;
+	uint64_t startNs;
+
+	if(W25QSim_Open(NULL) != 0)
+	{
+		return -1;
+	}
+	Workload_Init(&source, workload, seed);
+	W25Q_Init();
+	SFS_Format(eraseCountArray, blockMapArray);
+	// Only the workload itself is measured
+	W25QSim_ResetStats();
+	startNs = W25QSim_Now();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < writes; i++)
+	{
+		uint32_t idleMs;
+		uint8_t block = Workload_Next(&source, &idleMs);
+
+		W25QSim_Advance(idleMs * 1000000ULL);
+		SFS_WriteData(eraseCountArray, blockMapArray, block, (uint8_t *)data, length);
+	}
+
+	stats = W25QSim_GetStats();
+	memset(result, 0, sizeof(*result));
+	result->workload = Workload_Name(workload);
+	result->writes = writes;
+	result->length = length;
+	result->hostSeconds = Bench_Seconds(&start);
+	result->simSeconds = (W25QSim_Now() - startNs) / 1e9;
+	result->flashBytes = stats->bytesProgrammed;
+	result->erasedBytes = ((uint64_t)stats->sectorErases * W25Q_SectorSize) +
+						  ((uint64_t)stats->block32kErases * (W25Q_BlockSize / 2)) +
+						  ((uint64_t)stats->block64kErases * W25Q_BlockSize) +
+						  ((uint64_t)stats->chipErases * W25Q_ByteCount);
+	result->writeAmplification = (double)stats->bytesProgrammed / ((double)writes * length);
+	Bench_EraseStats(result);
+	W25QSim_Close();
+	return 0;
+}
+
+static double Bench_WritesPerSecond(const BenchResult *result)
+{
+	return (result->simSeconds > 0) ? result->writes / result->simSeconds : 0;
+}
+
+static void Bench_Print(const BenchResult *result)
+{
+	printf("%-10s %8u %10.1f %12llu %8.3f %9.2f %9.2f %7u %10.2f %9.3f\n",
+		   result->workload, result->writes, Bench_WritesPerSecond(result),
+		   (unsigned long long)result->flashBytes, result->writeAmplification,
+		   result->eraseMean, result->eraseStddev, result->eraseMax - result->eraseMin,
+		   result->simSeconds, result->hostSeconds);
+}
+
+static void Bench_WriteCsv(FILE *csv, const BenchResult *results, uint32_t count)
+{
+	fprintf(csv, "workload,writes,length,writes_per_s,flash_bytes,erased_bytes,write_amplification,"
+				 "erase_mean,erase_stddev,erase_min,erase_max,erase_spread,sim_seconds,host_seconds\n");
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const BenchResult *r = &results[i];
+
+		fprintf(csv, "%s,%u,%u,%.3f,%llu,%llu,%.4f,%.4f,%.4f,%u,%u,%u,%.6f,%.6f\n",
+				r->workload, r->writes, r->length, Bench_WritesPerSecond(r),
+				(unsigned long long)r->flashBytes, (unsigned long long)r->erasedBytes,
+				r->writeAmplification, r->eraseMean, r->eraseStddev, r->eraseMin, r->eraseMax,
+				r->eraseMax - r->eraseMin, r->simSeconds, r->hostSeconds);
+	}
+}
+
+static void Bench_WriteJson(FILE *json, const BenchResult *results, uint32_t count, uint32_t swapThreshold)
+{
+	fprintf(json, "{\n  \"swap_threshold\": %u,\n  \"results\": [\n", swapThreshold);
+	for(uint32_t i = 0; i < count; i++)
+	{
+		const BenchResult *r = &results[i];
+
+		fprintf(json, "    {\"workload\": \"%s\", \"writes\": %u, \"length\": %u, \"writes_per_s\": %.3f, "
+					  "\"flash_bytes\": %llu, \"erased_bytes\": %llu, \"write_amplification\": %.4f, "
+					  "\"erase_mean\": %.4f, \"erase_stddev\": %.4f, \"erase_min\": %u, \"erase_max\": %u, "
+					  "\"erase_spread\": %u, \"sim_seconds\": %.6f, \"host_seconds\": %.6f}%s\n",
+				r->workload, r->writes, r->length, Bench_WritesPerSecond(r),
+				(unsigned long long)r->flashBytes, (unsigned long long)r->erasedBytes,
+				r->writeAmplification, r->eraseMean, r->eraseStddev, r->eraseMin, r->eraseMax,
+				r->eraseMax - r->eraseMin, r->simSeconds, r->hostSeconds, (i + 1 < count) ? "," : "");
+	}
+	fprintf(json, "  ]\n}\n");
+}
+
+static int Bench_Export(const char *path, const BenchResult *results, uint32_t count, int json)
+{
+	FILE *file = fopen(path, "w");
+
+	if(file == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+	if(json)
+	{
+		Bench_WriteJson(file, results, count, SFS_GetSwapThreshold());
+	}
+	else
+	{
+		Bench_WriteCsv(file, results, count);
+	}
+	fclose(file);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static uint8_t data[W25Q_BlockSize];
+	BenchResult results[WORKLOAD_COUNT];
+	uint32_t resultCount = 0;
+	int selected = -1;
+	uint32_t writes = 500;
+	uint32_t length = 4096;
+	uint64_t seed = 1;
+	const char *csvPath = NULL;
+	const char *jsonPath = NULL;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(i + 1 < argc && strcmp(argv[i], "-w") == 0)
+		{
+			selected = Workload_Parse(argv[++i]);
+			if(selected < 0)
+			{
+				fprintf(stderr, "unknown workload %s\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-n") == 0)
+		{
+			writes = strtoul(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-l") == 0)
+		{
+			length = strtoul(argv[++i], NULL, 0);
+			length = (length == 0) ? 1 : (length > sizeof(data)) ? sizeof(data) : length;
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+		{
+			SFS_SetSwapThreshold(strtoul(argv[++i], NULL, 0));
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-r") == 0)
+		{
+			seed = strtoull(argv[++i], NULL, 0);
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-c") == 0)
+		{
+			csvPath = argv[++i];
+		}
+		else if(i + 1 < argc && strcmp(argv[i], "-j") == 0)
+		{
+			jsonPath = argv[++i];
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-w workload] [-n writes] [-l length] [-s swap-threshold] "
+							"[-r seed] [-c results.csv] [-j results.json]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	for(uint32_t i = 0; i < sizeof(data); i++)
+	{
+		data[i] = i * 31;
+	}
+
+	printf("%-10s %8s %10s %12s %8s %9s %9s %7s %10s %9s\n", "workload", "writes", "writes/s",
+		   "flash bytes", "WA", "erase avg", "erase sd", "spread", "sim s", "host s");
+	for(int workload = 0; workload < WORKLOAD_COUNT; workload++)
+	{
+		if(selected >= 0 && workload != selected)
+		{
+			continue;
+		}
+		if(Bench_Run(workload, writes, length, seed, data, &results[resultCount]) != 0)
+		{
+			return 1;
+		}
+		Bench_Print(&results[resultCount++]);
+	}
+
+	if(csvPath != NULL && Bench_Export(csvPath, results, resultCount, 0) != 0)
+	{
+		return 1;
+	}
+	if(jsonPath != NULL && Bench_Export(jsonPath, results, resultCount, 1) != 0)
+	{
+		return 1;
+	}
+	return 0;
+}
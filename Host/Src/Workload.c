@@ -0,0 +1,143 @@
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include "Workload.h"
+
+static const char *workloadNames[WORKLOAD_COUNT] =
+{
+	"uniform", "sequential", "hotspot", "zipf", "bursty"
+};
+
+// xorshift64*, so every run with the same seed writes the same blocks
+static uint32_t Workload_Random(Workload_Source *source)
+{
+	source->state ^= source->state >> 12;
+	source->state ^= source->state << 25;
+	source->state ^= source->state >> 27;
+	return (source->state * 0x2545F4914F6CDD1DULL) >> 32;
+}
+
+static double Workload_Uniform(Workload_Source *source)
+{
+	return Workload_Random(source) / 4294967296.0;
+}
+
+static uint8_t Workload_Zipf(Workload_Source *source)
+{
+	double draw = Workload_Uniform(source);
+	uint32_t low = 0;
+	uint32_t high = TOTAL_BLOCKS - 1;
+
+	while(low < high)
+	{
+		uint32_t middle = (low + high) / 2;
+
+		if(source->zipfCdf[middle] < draw)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+const char *Workload_Name(Workload workload)
+{
+	return (workload < WORKLOAD_COUNT) ? workloadNames[workload] : "unknown";
+}
+
+/**
+ * @brief	Looks a workload up by name
+ * @return	Workload, or -1 if the name is unknown
+ */
+int Workload_Parse(const char *name)
+{
+	for(int workload = 0; workload < WORKLOAD_COUNT; workload++)
+	{
+		if(strcmp(name, workloadNames[workload]) == 0)
+		{
+			return workload;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief	Starts a block sequence
+ * @param	source		Source state to fill in
+ * @param	workload	Access pattern
+ * @param	seed		Random seed, 0 is treated as 1
+ */
+void Workload_Init(Workload_Source *source, Workload workload, uint64_t seed)
+{
+	double total = 0;
+
+	memset(source, 0, sizeof(*source));
+	source->workload = workload;
+	source->state = seed ? seed : 1;
+	for(uint32_t i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		total += 1.0 / pow(i + 1, WORKLOAD_ZIPF_EXPONENT);
+		source->zipfCdf[i] = total;
+	}
+	for(uint32_t i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		source->zipfCdf[i] /= total;
+	}
+}
+
+/**
+ * @brief	Picks the logical block of the next write
+ * @param	source	Source state
+ * @param	idleMs	Receives how long the writer stays idle before this write,
+ * 					may be NULL when the caller has no clock
+ * @return	Logical block number
+ */
+uint8_t Workload_Next(Workload_Source *source, uint32_t *idleMs)
+{
+	uint32_t hotBlocks = (TOTAL_BLOCKS * WORKLOAD_HOT_BLOCKS) / 100;
+	uint32_t idle = 0;
+	uint8_t block;
+
+	switch(source->workload)
+	{
+		case WORKLOAD_SEQUENTIAL:
+			block = source->next++ % TOTAL_BLOCKS;
+			break;
+		case WORKLOAD_HOTSPOT:
+			if((Workload_Random(source) % 100) < WORKLOAD_HOT_WRITES)
+			{
+				block = Workload_Random(source) % hotBlocks;
+			}
+			else
+			{
+				block = hotBlocks + (Workload_Random(source) % (TOTAL_BLOCKS - hotBlocks));
+			}
+			break;
+		case WORKLOAD_ZIPF:
+			block = Workload_Zipf(source);
+			break;
+		case WORKLOAD_BURSTY:
+			if(source->burstLeft == 0)
+			{
+				idle = WORKLOAD_BURST_IDLE_MS;
+				source->burstBlock = Workload_Random(source) % TOTAL_BLOCKS;
+				source->burstLeft = WORKLOAD_BURST_LENGTH;
+			}
+			source->burstLeft--;
+			block = source->burstBlock;
+			break;
+		case WORKLOAD_UNIFORM:
+		default :
+			block = Workload_Random(source) % TOTAL_BLOCKS;
+			break;
+	}
+	if(idleMs != NULL)
+	{
+		*idleMs = idle;
+	}
+	return block;
+}
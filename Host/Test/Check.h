@@ -0,0 +1,42 @@
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+
+/* Assertions for the host tests, one test program per translation unit.
+ * A failed check prints where it failed and carries on, CHECK_DONE() turns
+ * the failure count into the exit status for make test. */
+
+static unsigned checkCount;
+static unsigned checkFailures;
+
+#define CHECK(condition)																\
+	do																					\
+	{																					\
+		checkCount++;																	\
+		if(!(condition))																\
+		{																				\
+			checkFailures++;															\
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);		\
+		}																				\
+	} while(0)
+
+#define CHECK_EQ(actual, expected)														\
+	do																					\
+	{																					\
+		long long actual_ = (long long)(actual);										\
+		long long expected_ = (long long)(expected);									\
+		checkCount++;																	\
+		if(actual_ != expected_)														\
+		{																				\
+			checkFailures++;															\
+			printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual,	\
+				   actual_, expected_);													\
+		}																				\
+	} while(0)
+
+#define CHECK_DONE(name)																\
+	(printf("%-12s %u checks, %u failed\n", (name), checkCount, checkFailures),		\
+	 (checkFailures == 0) ? 0 : 1)
+
+#endif
@@ -0,0 +1,201 @@
+#include <string.h>
+#include "W25Qxx.h"
+#include "SWAP_FS.h"
+#include "W25QSim.h"
+#include "Check.h"
+
+/* W25Q_EraseRange() and the erase in SFS_WriteData() on the simulated
+ * chip. Erase commands are counted by the simulator, the erased-sector
+ * bitmap is checked through the erases it lets the driver skip. */
+
+#define BASE			(16 * W25Q_BlockSize)
+#define REGION_SIZE		(4 * W25Q_BlockSize)
+
+static uint8_t buffer[REGION_SIZE];
+
+typedef struct
+{
+	uint32_t sectors;
+	uint32_t halves;
+	uint32_t blocks;
+} EraseCount;
+
+static EraseCount TestErase_Count(void)
+{
+	const W25QSim_Stats *stats = W25QSim_GetStats();
+	EraseCount count = { stats->sectorErases, stats->block32kErases, stats->block64kErases };
+
+	W25QSim_ResetStats();
+	return count;
+}
+
+static uint8_t TestErase_IsFilled(uint32_t address, uint32_t length, uint8_t value)
+{
+	const uint8_t *array = W25QSim_Array();
+
+	for(uint32_t i = 0; i < length; i++)
+	{
+		if(array[address + i] != value)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// Programs the whole region with zeros, which also marks it as not erased
+static void TestErase_Fill(void)
+{
+	memset(buffer, 0x00, sizeof(buffer));
+	W25Q_EraseRange(BASE, REGION_SIZE);
+	W25Q_WriteData(BASE / W25Q_PageSize, 0, REGION_SIZE, buffer);
+	TestErase_Count();
+}
+
+static void TestErase_Parameters(void)
+{
+	EraseCount count;
+
+	TestErase_Fill();
+	CHECK_EQ(W25Q_EraseRange(BASE, 0), W25Q_OK);
+	CHECK_EQ(W25Q_EraseRange(BASE + 1, W25Q_SectorSize), W25Q_ERROR_PARAM);
+	CHECK_EQ(W25Q_EraseRange(BASE, W25Q_SectorSize - 1), W25Q_ERROR_PARAM);
+	CHECK_EQ(W25Q_EraseRange(BASE + W25Q_SectorSize, W25Q_SectorSize + 1), W25Q_ERROR_PARAM);
+	CHECK_EQ(W25Q_EraseRange(W25Q_ByteCount - W25Q_SectorSize, 2 * W25Q_SectorSize), W25Q_ERROR_PARAM);
+	count = TestErase_Count();
+	CHECK_EQ(count.sectors + count.halves + count.blocks, 0);
+	CHECK(TestErase_IsFilled(BASE, REGION_SIZE, 0x00));
+}
+
+static void TestErase_SingleSector(void)
+{
+	uint32_t address = BASE + W25Q_BlockSize - W25Q_SectorSize;
+	uint32_t sector = address / W25Q_SectorSize;
+	uint32_t before;
+	EraseCount count;
+
+	TestErase_Fill();
+	before = W25QSim_SectorEraseCount(sector);
+	CHECK_EQ(W25Q_EraseRange(address, W25Q_SectorSize), W25Q_OK);
+	count = TestErase_Count();
+	CHECK_EQ(count.sectors, 1);
+	CHECK_EQ(count.halves + count.blocks, 0);
+	CHECK_EQ(W25QSim_SectorEraseCount(sector), before + 1);
+	CHECK(TestErase_IsFilled(address, W25Q_SectorSize, 0xFF));
+	// Both neighbours across the 4K and 64K boundaries keep their data
+	CHECK(TestErase_IsFilled(address - W25Q_SectorSize, W25Q_SectorSize, 0x00));
+	CHECK(TestErase_IsFilled(address + W25Q_SectorSize, W25Q_SectorSize, 0x00));
+}
+
+/*
+ * 28K..168K into the region: sector 7, the upper 32K half, a full 64K
+ * block, a 32K half and two sectors.
+ */
+static void TestErase_MixedRange(void)
+{
+	uint32_t start = BASE + (7 * W25Q_SectorSize);
+	uint32_t end = BASE + (2 * W25Q_BlockSize) + (W25Q_BlockSize / 2) + (2 * W25Q_SectorSize);
+	EraseCount count;
+
+	TestErase_Fill();
+	CHECK_EQ(W25Q_EstimateEraseRange(start, end - start),
+			 (3 * W25Q_TYPICAL_SECTOR_ERASE) + (2 * W25Q_TYPICAL_32KBLOCK_ERASE) + W25Q_TYPICAL_64KBLOCK_ERASE);
+	CHECK_EQ(W25Q_EraseRange(start, end - start), W25Q_OK);
+	count = TestErase_Count();
+	CHECK_EQ(count.sectors, 3);
+	CHECK_EQ(count.halves, 2);
+	CHECK_EQ(count.blocks, 1);
+	CHECK(TestErase_IsFilled(start, end - start, 0xFF));
+	CHECK(TestErase_IsFilled(BASE, start - BASE, 0x00));
+	CHECK(TestErase_IsFilled(end, BASE + REGION_SIZE - end, 0x00));
+
+	// Everything is known blank now, so nothing is sent again
+	CHECK_EQ(W25Q_EraseRange(start, end - start), W25Q_OK);
+	count = TestErase_Count();
+	CHECK_EQ(count.sectors + count.halves + count.blocks, 0);
+
+	// Programming one byte makes only its sector dirty
+	buffer[0] = 0x5A;
+	W25Q_WriteData((BASE + W25Q_BlockSize + 100) / W25Q_PageSize, (BASE + W25Q_BlockSize + 100) % W25Q_PageSize,
+				   1, buffer);
+	TestErase_Count();
+	CHECK_EQ(W25Q_EraseRange(start, end - start), W25Q_OK);
+	count = TestErase_Count();
+	CHECK_EQ(count.sectors, 1);
+	CHECK_EQ(count.halves + count.blocks, 0);
+	CHECK(TestErase_IsFilled(start, end - start, 0xFF));
+}
+
+// Rewriting a block must erase it first, or the new data would be ANDed into the old
+static void TestErase_SfsWrite(void)
+{
+	static uint32_t eraseCountArray[TOTAL_BLOCKS];
+	static uint8_t blockMapArray[TOTAL_BLOCKS];
+	uint32_t length = W25Q_SectorSize + 1000;
+	uint32_t address = 3 * W25Q_BlockSize;
+	uint32_t sector = address / W25Q_SectorSize;
+	uint32_t before[3];
+	uint32_t firstCount;
+
+	SFS_Format(eraseCountArray, blockMapArray);
+	for(uint32_t i = 0; i < 3; i++)
+	{
+		before[i] = W25QSim_SectorEraseCount(sector + i);
+	}
+
+	memset(buffer, 0x0F, length);
+	SFS_WriteData(eraseCountArray, blockMapArray, 3, buffer, length);
+	firstCount = eraseCountArray[3];
+	memset(buffer, 0xF0, length);
+	SFS_WriteData(eraseCountArray, blockMapArray, 3, buffer, length);
+
+	CHECK(memcmp(W25QSim_Array() + address, buffer, length) == 0);
+	CHECK(TestErase_IsFilled(address + length, W25Q_SectorSize, 0xFF));
+	// Only the sectors the data covers are erased, once per write
+	CHECK_EQ(W25QSim_SectorEraseCount(sector), before[0] + 2);
+	CHECK_EQ(W25QSim_SectorEraseCount(sector + 1), before[1] + 2);
+	CHECK_EQ(W25QSim_SectorEraseCount(sector + 2), before[2]);
+	CHECK_EQ(eraseCountArray[3], firstCount + 1);
+	CHECK_EQ(blockMapArray[3], 3);
+}
+
+// Metadata erases keep the calibration pattern, so calibration never reprograms it
+static void TestErase_CalibrationKept(void)
+{
+	static uint32_t eraseCountArray[TOTAL_BLOCKS];
+	static uint8_t blockMapArray[TOTAL_BLOCKS];
+	uint8_t pattern[W25Q_CAL_LENGTH];
+	uint8_t after[W25Q_CAL_LENGTH];
+	uint32_t programs;
+
+	W25Q_ReadSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, pattern, W25Q_CAL_LENGTH);
+	CHECK(pattern[0] != 0xFF || pattern[1] != 0xFF);
+
+	SFS_InitFS();
+	SFS_Format(eraseCountArray, blockMapArray);
+	W25Q_ReadSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, after, W25Q_CAL_LENGTH);
+	CHECK(memcmp(after, pattern, W25Q_CAL_LENGTH) == 0);
+	CHECK_EQ(blockMapArray[0], 0xFF);
+
+	programs = W25QSim_GetStats()->securityPrograms;
+	CHECK_EQ(W25Q_Calibrate(), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->securityPrograms, programs);
+}
+
+int main(void)
+{
+	if(W25QSim_Open(NULL) != 0)
+	{
+		return 1;
+	}
+	W25Q_Init();
+
+	TestErase_Parameters();
+	TestErase_SingleSector();
+	TestErase_MixedRange();
+	TestErase_SfsWrite();
+	TestErase_CalibrationKept();
+
+	W25QSim_Close();
+	return CHECK_DONE("erase");
+}
@@ -0,0 +1,226 @@
+#include <string.h>
+#include "SHELL.h"
+#include "Check.h"
+
+/* The line editor and dispatcher fed byte by byte, with the output
+ * captured. A small command table records what the handlers were called
+ * with, so each test can check both the echo and the dispatch. */
+
+#define CAPTURE_SIZE	1024
+
+static char captured[CAPTURE_SIZE];
+static uint32_t capturedLength;
+static uint32_t runCount;
+static int lastArgc;
+static char lastArgs[SHELL_MAX_ARGS][SHELL_LINE_SIZE];
+
+static uint32_t TestShell_Capture(const char *data, uint32_t length)
+{
+	if(capturedLength + length >= CAPTURE_SIZE)
+	{
+		length = CAPTURE_SIZE - 1 - capturedLength;
+	}
+	memcpy(&captured[capturedLength], data, length);
+	capturedLength += length;
+	captured[capturedLength] = '\0';
+	return length;
+}
+
+static SHELL_Status TestShell_Echo(int argc, char **argv)
+{
+	runCount++;
+	lastArgc = argc;
+	for(int i = 0; i < argc; i++)
+	{
+		strcpy(lastArgs[i], argv[i]);
+	}
+	return SHELL_OK;
+}
+
+static SHELL_Status TestShell_Add(int argc, char **argv)
+{
+	uint32_t a;
+	uint32_t b;
+
+	runCount++;
+	if(argc != 3 || !SHELL_ParseUint(argv[1], &a) || !SHELL_ParseUint(argv[2], &b))
+	{
+		return SHELL_USAGE;
+	}
+	SHELL_Printf("%lu\r\n", (unsigned long)(a + b));
+	return SHELL_OK;
+}
+
+static const SHELL_Command testCommands[] =
+{
+	{ "echo",	NULL,		"record the arguments",	TestShell_Echo },
+	{ "add",	"<a> <b>",	"print a + b",			TestShell_Add },
+};
+
+static void TestShell_Reset(void)
+{
+	runCount = 0;
+	lastArgc = 0;
+	memset(lastArgs, 0, sizeof(lastArgs));
+	SHELL_Init(testCommands, sizeof(testCommands) / sizeof(testCommands[0]), TestShell_Capture);
+	capturedLength = 0;
+	captured[0] = '\0';
+}
+
+static void TestShell_Feed(const char *text)
+{
+	SHELL_InputBuffer((const uint8_t *)text, strlen(text));
+}
+
+// Compares and then clears everything printed since the last call
+static void TestShell_Expect(const char *expected, int lineNumber)
+{
+	CHECK(strcmp(captured, expected) == 0);
+	if(strcmp(captured, expected) != 0)
+	{
+		printf("  line %d: output \"%s\"\n", lineNumber, captured);
+	}
+	capturedLength = 0;
+	captured[0] = '\0';
+}
+
+#define EXPECT_OUTPUT(text)		TestShell_Expect((text), __LINE__)
+
+static void TestShell_LineEndings(void)
+{
+	// Init prints the first prompt
+	TestShell_Reset();
+	SHELL_Init(testCommands, 2, TestShell_Capture);
+	EXPECT_OUTPUT(SHELL_PROMPT);
+
+	TestShell_Feed("echo a\r");
+	EXPECT_OUTPUT("echo a\r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 1);
+
+	TestShell_Feed("echo b\n");
+	EXPECT_OUTPUT("echo b\r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 2);
+
+	// CRLF runs the line once, the LF is not an empty second line
+	TestShell_Feed("echo c\r\n");
+	EXPECT_OUTPUT("echo c\r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 3);
+	CHECK(strcmp(lastArgs[1], "c") == 0);
+
+	// LFCR and two CRs are two line ends each
+	TestShell_Feed("\n\r\r\r");
+	EXPECT_OUTPUT("\r\n" SHELL_PROMPT "\r\n" SHELL_PROMPT "\r\n" SHELL_PROMPT "\r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 3);
+}
+
+static void TestShell_Editing(void)
+{
+	TestShell_Reset();
+	TestShell_Feed("echi\bo  one twx\x7fo \r");
+	EXPECT_OUTPUT("echi\b \bo  one twx\b \bo \r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 1);
+	CHECK_EQ(lastArgc, 3);
+	CHECK(strcmp(lastArgs[0], "echo") == 0);
+	CHECK(strcmp(lastArgs[1], "one") == 0);
+	CHECK(strcmp(lastArgs[2], "two") == 0);
+
+	// Backspace on an empty line prints nothing
+	TestShell_Feed("\b\x7f");
+	EXPECT_OUTPUT("");
+
+	// Ctrl-C drops the line without running it
+	TestShell_Feed("echo lost\x03");
+	EXPECT_OUTPUT("echo lost^C\r\n" SHELL_PROMPT);
+	TestShell_Feed("\r");
+	EXPECT_OUTPUT("\r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 1);
+
+	// Other control characters, tab included, are ignored
+	TestShell_Feed("\x01\x07\t");
+	EXPECT_OUTPUT("");
+}
+
+static void TestShell_EscapeSequences(void)
+{
+	TestShell_Reset();
+	// Up arrow, Delete key with a parameter, then ESC followed by a letter
+	TestShell_Feed("ec\x1b[Ah\x1b[3~o\x1bx a\r");
+	EXPECT_OUTPUT("echo a\r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 1);
+	CHECK_EQ(lastArgc, 2);
+	CHECK(strcmp(lastArgs[1], "a") == 0);
+}
+
+static void TestShell_Overlong(void)
+{
+	char text[SHELL_LINE_SIZE + 16];
+	char expected[256];
+
+	TestShell_Reset();
+	memset(text, 'e', sizeof(text) - 1);
+	text[sizeof(text) - 1] = '\0';
+	TestShell_Feed(text);
+	CHECK_EQ(capturedLength, SHELL_LINE_SIZE - 1);
+	capturedLength = 0;
+	captured[0] = '\0';
+
+	// Backspace cannot rescue a line that already overflowed
+	TestShell_Feed("\b\r");
+	snprintf(expected, sizeof(expected), "\r\nline longer than %u characters\r\n" SHELL_PROMPT,
+			 SHELL_LINE_SIZE - 1);
+	EXPECT_OUTPUT(expected);
+	CHECK_EQ(runCount, 0);
+
+	// The next line is unaffected
+	TestShell_Feed("echo ok\r");
+	EXPECT_OUTPUT("echo ok\r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 1);
+}
+
+static void TestShell_Dispatch(void)
+{
+	char text[] = "add 2 0x10";
+	char tabs[] = "echo\tx\t\ty";
+
+	TestShell_Reset();
+	TestShell_Feed("add 2 3\r");
+	EXPECT_OUTPUT("add 2 3\r\n5\r\n" SHELL_PROMPT);
+
+	TestShell_Feed("add 2\r");
+	EXPECT_OUTPUT("add 2\r\nusage: add <a> <b>\r\n" SHELL_PROMPT);
+	TestShell_Feed("add 2 -1\r");
+	EXPECT_OUTPUT("add 2 -1\r\nusage: add <a> <b>\r\n" SHELL_PROMPT);
+
+	TestShell_Feed("nope 1\r");
+	EXPECT_OUTPUT("nope 1\r\nunknown command 'nope', try help\r\n" SHELL_PROMPT);
+
+	// Blank lines are not commands
+	TestShell_Feed("   \r");
+	EXPECT_OUTPUT("   \r\n" SHELL_PROMPT);
+	CHECK_EQ(runCount, 3);
+
+	CHECK_EQ(SHELL_Execute(text), SHELL_OK);
+	EXPECT_OUTPUT("18\r\n");
+	CHECK_EQ(SHELL_Execute(strcpy(text, "bad")), SHELL_USAGE);
+	EXPECT_OUTPUT("unknown command 'bad', try help\r\n");
+	CHECK_EQ(SHELL_Execute(tabs), SHELL_OK);
+	CHECK_EQ(lastArgc, 3);
+	CHECK(strcmp(lastArgs[2], "y") == 0);
+
+	TestShell_Feed("help\r");
+	EXPECT_OUTPUT("help\r\n"
+				  "help       list commands\r\n"
+				  "echo       record the arguments\r\n"
+				  "add        print a + b\r\n"
+				  "             add <a> <b>\r\n" SHELL_PROMPT);
+}
+
+int main(void)
+{
+	TestShell_LineEndings();
+	TestShell_Editing();
+	TestShell_EscapeSequences();
+	TestShell_Overlong();
+	TestShell_Dispatch();
+	return CHECK_DONE("shell");
+}
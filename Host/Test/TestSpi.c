@@ -0,0 +1,207 @@
+#include <string.h>
+#include "SPI.h"
+#include "RegMock.h"
+#include "Check.h"
+
+/* SPI2 transfer paths on the register mock. The slave model logs every
+ * MOSI byte and answers with a running counter, so the tests can tell
+ * which bytes went out and where the received ones landed. */
+
+#define TEST_SIZE		64
+
+static uint8_t mosiLog[256];
+static uint32_t mosiCount;
+static uint8_t misoNext;
+static uint32_t callbackCount;
+
+static uint8_t TestSpi_Slave(uint8_t mosi)
+{
+	if(mosiCount < sizeof(mosiLog))
+	{
+		mosiLog[mosiCount] = mosi;
+	}
+	mosiCount++;
+	return misoNext++;
+}
+
+static void TestSpi_Callback(void)
+{
+	callbackCount++;
+}
+
+static void TestSpi_Reset(void)
+{
+	RegMock_Init(TestSpi_Slave);
+	SPI2_Init();
+	memset(mosiLog, 0, sizeof(mosiLog));
+	mosiCount = 0;
+	misoNext = 0x40;
+	callbackCount = 0;
+}
+
+static void TestSpi_Pattern(uint8_t *buffer, uint32_t size, uint8_t seed)
+{
+	for(uint32_t i = 0; i < size; i++)
+	{
+		buffer[i] = seed + (i * 7);
+	}
+}
+
+static void TestSpi_FullDuplex(void)
+{
+	uint8_t tx[TEST_SIZE];
+	uint8_t rx[TEST_SIZE];
+
+	TestSpi_Reset();
+	TestSpi_Pattern(tx, sizeof(tx), 1);
+	memset(rx, 0, sizeof(rx));
+	SPI2_DMA_TransmitReceive(tx, rx, sizeof(tx));
+
+	CHECK_EQ(mosiCount, TEST_SIZE);
+	CHECK(memcmp(mosiLog, tx, TEST_SIZE) == 0);
+	for(uint32_t i = 0; i < TEST_SIZE; i++)
+	{
+		CHECK_EQ(rx[i], (uint8_t)(0x40 + i));
+	}
+	CHECK_EQ(RegMock_DMABytes(), TEST_SIZE);
+	CHECK(!SPI2_DMA_IsBusy());
+	CHECK_EQ(Mock_SPI2.CR2 & (SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN), 0);
+}
+
+// TX-only: the received bytes go to the dummy sink without address increment
+static void TestSpi_TransmitOnly(void)
+{
+	uint8_t tx[TEST_SIZE];
+	uint8_t copy[TEST_SIZE];
+
+	TestSpi_Reset();
+	TestSpi_Pattern(tx, sizeof(tx), 9);
+	memcpy(copy, tx, sizeof(tx));
+	SPI2_DMA_TransmitReceive(tx, NULL, sizeof(tx));
+
+	CHECK_EQ(mosiCount, TEST_SIZE);
+	CHECK(memcmp(mosiLog, copy, TEST_SIZE) == 0);
+	CHECK(memcmp(tx, copy, TEST_SIZE) == 0);
+	CHECK_EQ(Mock_DMA1_Stream3.CR & DMA_SxCR_MINC, 0);
+	CHECK(Mock_DMA1_Stream4.CR & DMA_SxCR_MINC);
+}
+
+// RX-only: 0xFF is clocked out from the dummy source without address increment
+static void TestSpi_ReceiveOnly(void)
+{
+	uint8_t rx[TEST_SIZE + 1];
+
+	TestSpi_Reset();
+	memset(rx, 0xAA, sizeof(rx));
+	SPI2_DMA_TransmitReceive(NULL, rx, TEST_SIZE);
+
+	CHECK_EQ(mosiCount, TEST_SIZE);
+	for(uint32_t i = 0; i < TEST_SIZE; i++)
+	{
+		CHECK_EQ(mosiLog[i], 0xFF);
+		CHECK_EQ(rx[i], (uint8_t)(0x40 + i));
+	}
+	CHECK_EQ(rx[TEST_SIZE], 0xAA);
+	CHECK_EQ(Mock_DMA1_Stream4.CR & DMA_SxCR_MINC, 0);
+	CHECK(Mock_DMA1_Stream3.CR & DMA_SxCR_MINC);
+}
+
+static void TestSpi_AsyncStart(void)
+{
+	uint8_t tx[TEST_SIZE];
+
+	TestSpi_Reset();
+	TestSpi_Pattern(tx, sizeof(tx), 3);
+
+	// An empty transfer completes on the spot
+	CHECK_EQ(SPI2_DMA_Start(tx, NULL, 0, TestSpi_Callback), 0);
+	CHECK_EQ(callbackCount, 1);
+	CHECK(!SPI2_DMA_IsBusy());
+
+	CHECK_EQ(SPI2_DMA_Start(tx, NULL, sizeof(tx), TestSpi_Callback), 0);
+	CHECK(SPI2_DMA_IsBusy());
+	CHECK_EQ(SPI2_DMA_Start(tx, NULL, sizeof(tx), NULL), 1);
+	CHECK_EQ(mosiCount, 0);
+	SPI2_DMA_Wait();
+	CHECK_EQ(callbackCount, 2);
+	CHECK_EQ(mosiCount, TEST_SIZE);
+	CHECK(!SPI2_DMA_IsBusy());
+}
+
+// Short transfers are polled and never reach the DMA streams
+static void TestSpi_Threshold(void)
+{
+	uint8_t tx[SPI2_DMA_THRESHOLD];
+	uint8_t rx[SPI2_DMA_THRESHOLD];
+
+	TestSpi_Reset();
+	TestSpi_Pattern(tx, sizeof(tx), 5);
+	SPI2_Transfer(tx, rx, SPI2_DMA_THRESHOLD - 1);
+	CHECK_EQ(RegMock_DMABytes(), 0);
+	// The mock loops DR back on polled transfers
+	CHECK(memcmp(rx, tx, SPI2_DMA_THRESHOLD - 1) == 0);
+
+	SPI2_Transfer(NULL, rx, SPI2_DMA_THRESHOLD - 1);
+	CHECK_EQ(RegMock_DMABytes(), 0);
+	CHECK_EQ(rx[0], 0xFF);
+
+	SPI2_Transfer(tx, rx, SPI2_DMA_THRESHOLD);
+	CHECK_EQ(RegMock_DMABytes(), SPI2_DMA_THRESHOLD);
+	CHECK_EQ(mosiCount, SPI2_DMA_THRESHOLD);
+}
+
+// The pipelined read kernel masks interrupts and restores the caller's PRIMASK
+static void TestSpi_ReadMasking(void)
+{
+	uint8_t buffer[SPI2_DMA_THRESHOLD];
+	static uint8_t longBuffer[1000];
+	uint32_t overruns;
+
+	TestSpi_Reset();
+	TestSpi_Pattern(buffer, sizeof(buffer), 7);
+	SPI2_Write(buffer, 4);
+	CHECK_EQ(RegMock_IrqDisables(), 0);
+
+	SPI2_Read(buffer, 15);
+	CHECK_EQ(RegMock_IrqDisables(), 1);
+	CHECK_EQ(RegMock_GetPrimask(), 0);
+	CHECK_EQ(buffer[14], 0xFF);
+
+	// 16-bit frames take the same path
+	SPI2_Read(buffer, 8);
+	CHECK_EQ(RegMock_IrqDisables(), 2);
+	CHECK_EQ(RegMock_GetPrimask(), 0);
+
+	// Already masked by the caller, so it must stay masked
+	RegMock_SetPrimask(1);
+	SPI2_Transfer(NULL, buffer, 3);
+	CHECK_EQ(RegMock_IrqDisables(), 3);
+	CHECK_EQ(RegMock_GetPrimask(), 1);
+	RegMock_SetPrimask(0);
+
+	// Long reads unmask between runs, the caller's state comes back at the end
+	SPI2_Read(longBuffer, sizeof(longBuffer));
+	CHECK_EQ(RegMock_IrqDisables(), 3 + ((sizeof(longBuffer) + SPI_READ_MASKED_BYTES - 1) / SPI_READ_MASKED_BYTES));
+	CHECK_EQ(RegMock_GetPrimask(), 0);
+	CHECK_EQ(longBuffer[sizeof(longBuffer) - 1], 0xFF);
+	SPI2_Read(longBuffer, sizeof(longBuffer) - 1);
+	CHECK_EQ(RegMock_IrqDisables(), 3 + (2 * ((sizeof(longBuffer) + SPI_READ_MASKED_BYTES - 1) / SPI_READ_MASKED_BYTES)));
+
+	overruns = SPI2_RxOverruns();
+	SPI2_Read(buffer, 4);
+	CHECK_EQ(SPI2_RxOverruns(), overruns);
+	Mock_SPI2.SR |= SPI_SR_OVR;
+	SPI2_Read(buffer, 4);
+	CHECK_EQ(SPI2_RxOverruns(), overruns + 1);
+}
+
+int main(void)
+{
+	TestSpi_FullDuplex();
+	TestSpi_TransmitOnly();
+	TestSpi_ReceiveOnly();
+	TestSpi_AsyncStart();
+	TestSpi_Threshold();
+	TestSpi_ReadMasking();
+	return CHECK_DONE("spi");
+}
@@ -0,0 +1,88 @@
+#include <string.h>
+#include "W25Qxx.h"
+#include "W25QSim.h"
+#include "Check.h"
+
+/* W25Q_ReadStream() on the simulated chip, with a callback that tries to
+ * use the driver while the stream still holds CS low. Every such call must
+ * be refused and the streamed data must come through intact. */
+
+#define STREAM_ADDRESS		(40 * W25Q_BlockSize)
+#define STREAM_LENGTH		(3 * W25Q_SectorSize)
+#define STREAM_CHUNK		1024
+
+typedef struct
+{
+	uint8_t data[STREAM_LENGTH];
+	uint32_t received;
+	uint32_t refused;
+	uint32_t calls;
+} StreamSink;
+
+static uint8_t TestStream_Callback(const uint8_t *chunk, uint32_t length, void *context)
+{
+	StreamSink *sink = context;
+	W25Q_Stream nested;
+	uint8_t probe[16];
+
+	memcpy(&sink->data[sink->received], chunk, length);
+	sink->received += length;
+	sink->calls++;
+
+	memset(probe, 0xA5, sizeof(probe));
+	W25Q_ReadData(0, 0, probe, sizeof(probe));
+	sink->refused += (probe[0] == 0xA5);
+	sink->refused += (W25Q_StreamOpen(&nested, 0, 16) == W25Q_ERROR_BUSY);
+	sink->refused += (W25Q_EraseSectorAsync(0, 0) == W25Q_ERROR_BUSY);
+	sink->refused += (W25Q_Complete() == W25Q_ERROR_BUSY);
+	sink->refused += (W25Q_WaitReady(10) == W25Q_ERROR_BUSY);
+	sink->refused += (W25Q_BlankCheck(0, 16) == 0);
+	sink->refused += (W25Q_ReadID() == 0);
+	return 1;
+}
+
+int main(void)
+{
+	static uint8_t pattern[STREAM_LENGTH];
+	static uint8_t chunk[STREAM_CHUNK];
+	static StreamSink sink;
+
+	if(W25QSim_Open(NULL) != 0)
+	{
+		return 1;
+	}
+	W25Q_Init();
+	for(uint32_t i = 0; i < STREAM_LENGTH; i++)
+	{
+		pattern[i] = (i * 13) ^ (i >> 8);
+	}
+	W25Q_EraseRange(STREAM_ADDRESS, STREAM_LENGTH);
+	W25Q_WriteData(STREAM_ADDRESS / W25Q_PageSize, 0, STREAM_LENGTH, pattern);
+	W25QSim_ResetStats();
+
+	CHECK_EQ(W25Q_ReadStream(STREAM_ADDRESS, STREAM_LENGTH, chunk, sizeof(chunk), TestStream_Callback, &sink),
+			 W25Q_OK);
+	CHECK_EQ(sink.received, STREAM_LENGTH);
+	CHECK(memcmp(sink.data, pattern, STREAM_LENGTH) == 0);
+	CHECK_EQ(sink.refused, sink.calls * 7);
+	// Only the stream itself reached the chip
+	CHECK_EQ(W25QSim_GetStats()->bytesRead, STREAM_LENGTH);
+	CHECK_EQ(W25QSim_GetStats()->sectorErases, 0);
+
+	// A one-byte buffer cannot be split, the stream falls back to one buffer
+	memset(&sink, 0, sizeof(sink));
+	CHECK_EQ(W25Q_ReadStream(STREAM_ADDRESS, 100, chunk, 1, TestStream_Callback, &sink), W25Q_OK);
+	CHECK_EQ(sink.received, 100);
+	CHECK_EQ(sink.calls, 100);
+	CHECK(memcmp(sink.data, pattern, 100) == 0);
+	CHECK_EQ(sink.refused, sink.calls * 7);
+
+	// With the stream closed the driver works again
+	CHECK(W25Q_ReadID() == W25QSIM_JEDEC_ID);
+	CHECK_EQ(W25Q_EraseSectorAsync(0, 0), W25Q_OK);
+	CHECK_EQ(W25Q_Complete(), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->sectorErases, 1);
+
+	W25QSim_Close();
+	return CHECK_DONE("stream");
+}
@@ -0,0 +1,126 @@
+#include <string.h>
+#include "STRIPE.h"
+#include "W25QSim.h"
+#include "Check.h"
+
+/* A striped volume over two simulated chips. The test port routes each
+ * device to its own chip by CS pin, so the chips are busy independently
+ * and the tests can check that erases and programs really overlap. */
+
+#define STRIPE_CHIPS		2
+#define WRITE_LENGTH		(3 * W25Q_BlockSize)
+
+static W25Q_Port stripePort;
+static W25Q_Device chip0 = W25Q_DEVICE_INIT(SPI2, GPIOB, 0);
+static W25Q_Device chip1 = W25Q_DEVICE_INIT(SPI2, GPIOB, 1);
+
+static void TestStripe_Init(W25Q_Device *device)
+{
+	W25QSim_SelectChip(device->csPin);
+	W25Q_DefaultPort.init(device);
+}
+
+static void TestStripe_Select(W25Q_Device *device)
+{
+	W25QSim_SelectChip(device->csPin);
+	W25Q_DefaultPort.select(device);
+}
+
+static void TestStripe_Deselect(W25Q_Device *device)
+{
+	W25QSim_SelectChip(device->csPin);
+	W25Q_DefaultPort.deselect(device);
+}
+
+static const W25QSim_Stats *TestStripe_Stats(uint8_t index)
+{
+	W25QSim_SelectChip(index);
+	return W25QSim_GetStats();
+}
+
+static void TestStripe_Erase(STRIPE_Volume *volume)
+{
+	uint64_t start;
+	uint64_t serialNs = 4ULL * W25Q_TYPICAL_64KBLOCK_ERASE * 1000000ULL;
+
+	W25Q_SelectDevice(&chip0);
+	start = W25QSim_Now();
+	CHECK_EQ(STRIPE_EraseBlocks(volume, 0, 4), W25Q_OK);
+	// Each chip erased two blocks, at the same time as the other one
+	CHECK_EQ(TestStripe_Stats(0)->block64kErases, 2);
+	CHECK_EQ(TestStripe_Stats(1)->block64kErases, 2);
+	CHECK(W25QSim_Now() - start < (serialNs * 3) / 4);
+	CHECK(W25Q_GetDevice() == &chip0);
+}
+
+static void TestStripe_Write(STRIPE_Volume *volume)
+{
+	static uint8_t data[WRITE_LENGTH];
+	static uint8_t readBack[WRITE_LENGTH];
+	uint32_t pages = WRITE_LENGTH / W25Q_PageSize;
+	uint64_t serialNs = (uint64_t)pages * 700000ULL;
+	uint64_t start;
+
+	for(uint32_t i = 0; i < WRITE_LENGTH; i++)
+	{
+		data[i] = (i * 31) ^ (i >> 9);
+	}
+	for(uint8_t i = 0; i < STRIPE_CHIPS; i++)
+	{
+		W25QSim_SelectChip(i);
+		W25QSim_ResetStats();
+	}
+
+	W25Q_SelectDevice(&chip1);
+	start = W25QSim_Now();
+	CHECK_EQ(STRIPE_Write(volume, 0, data, WRITE_LENGTH), W25Q_OK);
+	CHECK(W25QSim_Now() - start < (serialNs * 4) / 5);
+	CHECK(W25Q_GetDevice() == &chip1);
+	CHECK_EQ(TestStripe_Stats(0)->pagePrograms, 2 * (W25Q_BlockSize / W25Q_PageSize));
+	CHECK_EQ(TestStripe_Stats(1)->pagePrograms, W25Q_BlockSize / W25Q_PageSize);
+	CHECK_EQ(TestStripe_Stats(0)->programConflicts + TestStripe_Stats(1)->programConflicts, 0);
+
+	// Blocks 0 and 2 live on chip 0, block 1 on chip 1
+	W25QSim_SelectChip(0);
+	CHECK(memcmp(W25QSim_Array(), data, W25Q_BlockSize) == 0);
+	CHECK(memcmp(W25QSim_Array() + W25Q_BlockSize, data + (2 * W25Q_BlockSize), W25Q_BlockSize) == 0);
+	W25QSim_SelectChip(1);
+	CHECK(memcmp(W25QSim_Array(), data + W25Q_BlockSize, W25Q_BlockSize) == 0);
+
+	memset(readBack, 0, sizeof(readBack));
+	CHECK_EQ(STRIPE_Read(volume, 0, readBack, WRITE_LENGTH), W25Q_OK);
+	CHECK(memcmp(readBack, data, WRITE_LENGTH) == 0);
+	CHECK(W25Q_GetDevice() == &chip1);
+}
+
+int main(void)
+{
+	static STRIPE_Volume volume;
+	W25Q_Device *devices[STRIPE_CHIPS] = { &chip0, &chip1 };
+
+	stripePort = W25Q_DefaultPort;
+	stripePort.init = TestStripe_Init;
+	stripePort.select = TestStripe_Select;
+	stripePort.deselect = TestStripe_Deselect;
+	for(uint8_t i = 0; i < STRIPE_CHIPS; i++)
+	{
+		W25QSim_SelectChip(i);
+		if(W25QSim_Open(NULL) != 0)
+		{
+			return 1;
+		}
+		devices[i]->port = &stripePort;
+		W25Q_InitDevice(devices[i]);
+	}
+	CHECK_EQ(STRIPE_Init(&volume, devices, STRIPE_CHIPS), W25Q_OK);
+
+	TestStripe_Erase(&volume);
+	TestStripe_Write(&volume);
+
+	for(uint8_t i = 0; i < STRIPE_CHIPS; i++)
+	{
+		W25QSim_SelectChip(i);
+		W25QSim_Close();
+	}
+	return CHECK_DONE("stripe");
+}
@@ -0,0 +1,161 @@
+#include <string.h>
+#include "TELEMETRY.h"
+#include "TlmStream.h"
+#include "COBS.h"
+#include "CRC.h"
+#include "Check.h"
+
+/* The telemetry link end to end: COBS and CRC on their own, then records
+ * made by the TLM_* calls fed straight into the tlm_decode frame parser,
+ * which must rebuild the tables the board sent. */
+
+#define BLOCKS		40
+
+static TlmState received;
+static uint32_t sentBytes;
+static uint8_t dropNext;
+
+static uint32_t TestTelemetry_Output(const char *data, uint32_t length)
+{
+	// Stands in for a frame lost on the link
+	if(dropNext)
+	{
+		dropNext = 0;
+		return length;
+	}
+	TlmStream_Feed(&received, (const uint8_t *)data, length);
+	sentBytes += length;
+	return length;
+}
+
+static void TestTelemetry_RoundTrip(const uint8_t *data, uint32_t length)
+{
+	static uint8_t encoded[COBS_MAX_ENCODED(1024)];
+	static uint8_t decoded[1024];
+	uint32_t encodedLength = COBS_Encode(data, length, encoded);
+	uint8_t zeros = 0;
+
+	CHECK(encodedLength <= COBS_MAX_ENCODED(length));
+	for(uint32_t i = 0; i < encodedLength; i++)
+	{
+		zeros += (encoded[i] == 0x00);
+	}
+	CHECK_EQ(zeros, 0);
+	CHECK_EQ(COBS_Decode(encoded, encodedLength, decoded), length);
+	CHECK(memcmp(decoded, data, length) == 0);
+}
+
+static void TestTelemetry_Cobs(void)
+{
+	static const uint8_t mixed[] = { 0x11, 0x22, 0x00, 0x33 };
+	static const uint8_t mixedEncoded[] = { 0x03, 0x11, 0x22, 0x02, 0x33 };
+	static const uint8_t zero[] = { 0x00 };
+	uint8_t data[1024];
+	uint8_t encoded[COBS_MAX_ENCODED(sizeof(data))];
+
+	CHECK_EQ(COBS_Encode(mixed, sizeof(mixed), encoded), sizeof(mixedEncoded));
+	CHECK(memcmp(encoded, mixedEncoded, sizeof(mixedEncoded)) == 0);
+	CHECK_EQ(COBS_Encode(zero, 1, encoded), 2);
+	CHECK(encoded[0] == 0x01 && encoded[1] == 0x01);
+	TestTelemetry_RoundTrip(mixed, sizeof(mixed));
+	TestTelemetry_RoundTrip(zero, 1);
+
+	memset(data, 0x00, sizeof(data));
+	TestTelemetry_RoundTrip(data, 300);
+
+	// Runs of non-zero bytes either side of the 254-byte block limit
+	for(uint32_t i = 0; i < sizeof(data); i++)
+	{
+		data[i] = (i % 255) + 1;
+	}
+	for(uint32_t length = 252; length <= 256; length++)
+	{
+		TestTelemetry_RoundTrip(data, length);
+	}
+	TestTelemetry_RoundTrip(data, 508);
+	TestTelemetry_RoundTrip(data, sizeof(data));
+	CHECK_EQ(COBS_Encode(data, 254, encoded), 256);
+	CHECK_EQ(encoded[0], 0xFF);
+
+	// A run of 254 followed by a zero
+	data[254] = 0x00;
+	TestTelemetry_RoundTrip(data, 300);
+
+	// A block code pointing past the end is rejected
+	encoded[0] = 0x05;
+	CHECK_EQ(COBS_Decode(encoded, 3, data), 0);
+}
+
+static void TestTelemetry_Crc(void)
+{
+	static const uint8_t check[] = "123456789";
+
+	// CRC-16/CCITT-FALSE check value
+	CHECK_EQ(CRC16_Update(CRC16_INIT, check, 9), 0x29B1);
+	// Updating in pieces gives the same result
+	CHECK_EQ(CRC16_Update(CRC16_Update(CRC16_INIT, check, 4), &check[4], 5), 0x29B1);
+	CHECK_EQ(CRC16_Update(CRC16_INIT, check, 0), CRC16_INIT);
+}
+
+static void TestTelemetry_Records(void)
+{
+	static const char noise[] = "> set telemetry 1\r\n";
+	uint32_t eraseCounts[BLOCKS];
+	uint8_t blockMap[BLOCKS];
+	uint8_t corrupt[] = { 0x00, 0x05, 0x01, 0x02, 0x03, 0x04, 0x00 };
+
+	memset(&received, 0, sizeof(received));
+	for(uint32_t i = 0; i < BLOCKS; i++)
+	{
+		// Zero bytes and 0xFF inside the payload both have to survive
+		eraseCounts[i] = (i == 0) ? 0xFFFFFFFF : (i << 16);
+		blockMap[i] = BLOCKS - 1 - i;
+	}
+
+	TLM_Init(NULL);
+	CHECK(!TLM_IsEnabled());
+	TLM_Mount(BLOCKS, 65536);
+	CHECK_EQ(sentBytes, 0);
+
+	TLM_Init(TestTelemetry_Output);
+	CHECK(TLM_IsEnabled());
+	TLM_Mount(BLOCKS, 65536);
+	TLM_Snapshot(eraseCounts, blockMap, BLOCKS);
+	CHECK_EQ(received.records, 1 + ((BLOCKS + TLM_SNAPSHOT_BLOCKS - 1) / TLM_SNAPSHOT_BLOCKS));
+	CHECK_EQ(received.blockCount, BLOCKS);
+	CHECK_EQ(received.blockSize, 65536);
+	CHECK(memcmp(received.eraseCount, eraseCounts, sizeof(eraseCounts)) == 0);
+	CHECK(memcmp(received.blockMap, blockMap, sizeof(blockMap)) == 0);
+
+	// Shell text between frames is skipped without losing records
+	TlmStream_Feed(&received, (const uint8_t *)noise, sizeof(noise) - 1);
+	TLM_Write(7, 9, 4096);
+	TLM_Remap(7, 9);
+	TLM_EraseCount(7, 0x01000000);
+	CHECK_EQ(received.blockMap[7], 9);
+	CHECK_EQ(received.eraseCount[7], 0x01000000);
+	CHECK_EQ(received.records, 7);
+	CHECK_EQ(received.lostRecords, 0);
+	CHECK_EQ(received.badFrames, 1);
+
+	// A frame with a bad CRC is dropped
+	TlmStream_Feed(&received, corrupt, sizeof(corrupt));
+	CHECK_EQ(received.badFrames, 2);
+	CHECK_EQ(received.records, 7);
+
+	// A record that never arrives shows up as a sequence gap
+	dropNext = 1;
+	TLM_Remap(1, 2);
+	TLM_Remap(3, 4);
+	CHECK_EQ(received.blockMap[3], 4);
+	CHECK_EQ(received.records, 8);
+	CHECK_EQ(received.lostRecords, 1);
+}
+
+int main(void)
+{
+	TestTelemetry_Cobs();
+	TestTelemetry_Crc();
+	TestTelemetry_Records();
+	return CHECK_DONE("telemetry");
+}
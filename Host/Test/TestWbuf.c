@@ -0,0 +1,107 @@
+#include <string.h>
+#include "WRITE_BUF.h"
+#include "W25QSim.h"
+#include "Check.h"
+
+/* WRITE_BUF on the simulated chip: small sequential writes must become
+ * one page program each, partial pages must age on the get_ticks()
+ * timebase, and page boundaries must follow the selected device. */
+
+#define WBUF_ADDRESS		(8 * W25Q_BlockSize)
+#define WBUF_TIMEOUT_MS		20
+#define WBUF_FRAGMENT		16
+
+static uint8_t data[4 * W25Q_PageSize];
+
+static void TestWbuf_Coalesce(WBUF_Buffer *buffer)
+{
+	uint32_t pageSize = W25Q_GetDevice()->pageSize;
+
+	W25QSim_ResetStats();
+	WBUF_Init(buffer, 0);
+	for(uint32_t i = 0; i < 2 * pageSize; i += WBUF_FRAGMENT)
+	{
+		CHECK_EQ(WBUF_Write(buffer, WBUF_ADDRESS + i, &data[i], WBUF_FRAGMENT), W25Q_OK);
+	}
+	// Both pages filled up and went out whole
+	CHECK_EQ(buffer->pagePrograms, 2);
+	CHECK_EQ(W25QSim_GetStats()->pagePrograms, 2);
+	CHECK_EQ(WBUF_ProgramsAvoided(buffer), (2 * pageSize / WBUF_FRAGMENT) - 2);
+	CHECK(memcmp(W25QSim_Array() + WBUF_ADDRESS, data, 2 * pageSize) == 0);
+
+	// A write that skips ahead flushes the partial page first
+	CHECK_EQ(WBUF_Write(buffer, WBUF_ADDRESS + (2 * pageSize), data, 8), W25Q_OK);
+	CHECK_EQ(WBUF_Write(buffer, WBUF_ADDRESS + (3 * pageSize), data, 8), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->pagePrograms, 3);
+	CHECK_EQ(WBUF_Sync(buffer), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->pagePrograms, 4);
+}
+
+static void TestWbuf_Age(WBUF_Buffer *buffer)
+{
+	uint32_t address = WBUF_ADDRESS + W25Q_SectorSize;
+
+	W25QSim_ResetStats();
+	WBUF_Init(buffer, WBUF_TIMEOUT_MS);
+	CHECK_EQ(WBUF_Poll(buffer), W25Q_OK);
+	CHECK_EQ(WBUF_Write(buffer, address, data, WBUF_FRAGMENT), W25Q_OK);
+
+	W25QSim_Advance((WBUF_TIMEOUT_MS / 2) * 1000000ULL);
+	CHECK_EQ(WBUF_Poll(buffer), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->pagePrograms, 0);
+
+	// Another write restarts the age
+	CHECK_EQ(WBUF_Write(buffer, address + WBUF_FRAGMENT, &data[WBUF_FRAGMENT], WBUF_FRAGMENT), W25Q_OK);
+	W25QSim_Advance((WBUF_TIMEOUT_MS / 2) * 1000000ULL);
+	CHECK_EQ(WBUF_Poll(buffer), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->pagePrograms, 0);
+
+	W25QSim_Advance((WBUF_TIMEOUT_MS / 2) * 1000000ULL);
+	CHECK_EQ(WBUF_Poll(buffer), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->pagePrograms, 1);
+	CHECK(memcmp(W25QSim_Array() + address, data, 2 * WBUF_FRAGMENT) == 0);
+
+	// Nothing left to flush
+	W25QSim_Advance(WBUF_TIMEOUT_MS * 1000000ULL);
+	CHECK_EQ(WBUF_Poll(buffer), W25Q_OK);
+	CHECK_EQ(W25QSim_GetStats()->pagePrograms, 1);
+}
+
+static void TestWbuf_DevicePageSize(WBUF_Buffer *buffer)
+{
+	W25Q_Device *device = W25Q_GetDevice();
+	uint32_t pageSize = device->pageSize;
+
+	// A device reporting smaller pages fills a buffer page sooner
+	device->pageSize = pageSize / 2;
+	TestWbuf_Coalesce(buffer);
+
+	device->pageSize = W25Q_MAX_PAGE_SIZE * 2;
+	CHECK_EQ(WBUF_Write(buffer, WBUF_ADDRESS, data, 1), W25Q_ERROR_PARAM);
+	device->pageSize = pageSize;
+}
+
+int main(void)
+{
+	static WBUF_Buffer buffer;
+
+	if(W25QSim_Open(NULL) != 0)
+	{
+		return 1;
+	}
+	W25Q_Init();
+	for(uint32_t i = 0; i < sizeof(data); i++)
+	{
+		data[i] = (i * 7) + 1;
+	}
+	W25Q_EraseRange(WBUF_ADDRESS, W25Q_BlockSize);
+
+	TestWbuf_Coalesce(&buffer);
+	W25Q_EraseRange(WBUF_ADDRESS, W25Q_BlockSize);
+	TestWbuf_Age(&buffer);
+	W25Q_EraseRange(WBUF_ADDRESS, W25Q_BlockSize);
+	TestWbuf_DevicePageSize(&buffer);
+
+	W25QSim_Close();
+	return CHECK_DONE("wbuf");
+}
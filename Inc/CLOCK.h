@@ -0,0 +1,35 @@
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <stdint.h>
+#include "stm32f4xx.h"
+
+#define CLOCK_HSI_HZ	16000000
+
+// PLL and bus dividers for SYSCLK = 84 MHz from the HSI
+typedef struct
+{
+	uint32_t pllM;			// VCO input = HSI / pllM, 1 to 2 MHz
+	uint32_t pllN;			// VCO output = VCO input * pllN
+	uint32_t pllP;			// SYSCLK = VCO output / pllP (2, 4, 6 or 8)
+	uint32_t pllQ;			// USB/SDIO clock = VCO output / pllQ
+	uint32_t ahbDivider;	// 1, 2, 4 ... 512
+	uint32_t apb1Divider;	// 1, 2, 4, 8 or 16, PCLK1 at most 42 MHz
+	uint32_t apb2Divider;	// 1, 2, 4, 8 or 16
+	uint32_t flashLatency;	// Wait states for HCLK at 2.7 to 3.6 V
+} CLOCK_Config;
+
+// Bus frequencies every peripheral driver derives its settings from
+typedef struct
+{
+	uint32_t sysclkHz;
+	uint32_t hclkHz;
+	uint32_t pclk1Hz;
+	uint32_t pclk2Hz;
+} CLOCK_Tree;
+
+void CLOCK_Init(void);
+void CLOCK_Configure(const CLOCK_Config *config);
+const CLOCK_Tree *CLOCK_Get(void);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef COBS_H_
+#define COBS_H_
+
+#include <stdint.h>
+
+// Worst-case encoded size of n bytes, without the 0x00 frame delimiter
+#define COBS_MAX_ENCODED(n)	((n) + ((n) / 254) + 1)
+
+uint32_t COBS_Encode(const uint8_t *input, uint32_t length, uint8_t *output);
+uint32_t COBS_Decode(const uint8_t *input, uint32_t length, uint8_t *output);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef COMMANDS_H_
+#define COMMANDS_H_
+
+#include <stdint.h>
+#include "SHELL.h"
+
+// Bytes moved per driver call by the throughput benchmarks
+#define CMD_BENCH_CHUNK		4096
+
+void CMD_Init(uint32_t *eraseCountArr, uint8_t *blockMap);
+void CMD_Poll(void);
+
+#endif
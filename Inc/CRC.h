@@ -0,0 +1,11 @@
+#ifndef CRC_H_
+#define CRC_H_
+
+#include <stdint.h>
+
+// CRC-16/CCITT-FALSE: polynomial 0x1021, initial value 0xFFFF
+#define CRC16_INIT	0xFFFF
+
+uint16_t CRC16_Update(uint16_t crc, const uint8_t *data, uint32_t length);
+
+#endif
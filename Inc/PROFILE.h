@@ -0,0 +1,61 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+
+/* Opt-in function profiling. Build with -DPROFILE_ENABLE=1 and put
+ * PROFILE_FUNCTION(); at the top of a function to record its calls,
+ * total/min/max time and a log2 histogram of its latency. With profiling
+ * disabled every macro expands to nothing and no data is kept. */
+
+#ifndef PROFILE_ENABLE
+#define PROFILE_ENABLE			0
+#endif
+
+// Bin n counts calls that took 2^n to 2^(n+1)-1 time units
+#define PROFILE_HISTOGRAM_BINS	32
+
+// Returns a free-running timestamp, DWT CYCCNT on target
+typedef uint32_t (*PROFILE_TimeSource)(void);
+
+typedef struct PROFILE_Entry
+{
+	const char *name;
+	struct PROFILE_Entry *next;
+	uint32_t calls;
+	uint64_t totalTime;
+	uint32_t minTime;
+	uint32_t maxTime;
+	uint32_t histogram[PROFILE_HISTOGRAM_BINS];
+} PROFILE_Entry;
+
+// One timed call, closed automatically when it goes out of scope
+typedef struct
+{
+	PROFILE_Entry *entry;
+	uint32_t start;
+} PROFILE_Scope;
+
+#if PROFILE_ENABLE
+
+#define PROFILE_FUNCTION()																	\
+	static PROFILE_Entry profileEntry_;														\
+	PROFILE_Scope profileScope_ __attribute__((cleanup(PROFILE_ScopeEnd))) =				\
+		PROFILE_ScopeBegin(&profileEntry_, __func__)
+
+void PROFILE_Init(PROFILE_TimeSource source);
+void PROFILE_Reset(void);
+void PROFILE_Dump(void);
+PROFILE_Scope PROFILE_ScopeBegin(PROFILE_Entry *entry, const char *name);
+void PROFILE_ScopeEnd(PROFILE_Scope *scope);
+
+#else
+
+#define PROFILE_FUNCTION()		do {} while(0)
+#define PROFILE_Init(source)	((void)(source))
+#define PROFILE_Reset()			((void)0)
+#define PROFILE_Dump()			((void)0)
+
+#endif
+
+#endif
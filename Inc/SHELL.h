@@ -0,0 +1,51 @@
+#ifndef SHELL_H_
+#define SHELL_H_
+
+#include <stdint.h>
+
+/* Line editor and command dispatcher. It only sees a byte stream in and a
+ * write function out, so the same parser runs on the host: feed bytes with
+ * SHELL_Input() and capture what the output function receives. */
+
+// Longest command line, longer input is discarded up to the next newline
+#ifndef SHELL_LINE_SIZE
+#define SHELL_LINE_SIZE			80
+#endif
+
+#define SHELL_MAX_ARGS			8
+
+// Longest single SHELL_Printf() result, the rest is cut off
+#define SHELL_PRINT_SIZE		128
+
+#define SHELL_PROMPT			"> "
+
+// Handler return codes
+typedef enum
+{
+	SHELL_OK = 0,
+	SHELL_USAGE,		// Arguments were wrong, the usage line is printed
+	SHELL_FAILED		// The command ran and reported its own error
+} SHELL_Status;
+
+// Sink for shell output, UART2_Write() on target
+typedef uint32_t (*SHELL_Output)(const char *data, uint32_t length);
+
+// argv[0] is the command name, the strings live until the handler returns
+typedef SHELL_Status (*SHELL_Handler)(int argc, char **argv);
+
+typedef struct
+{
+	const char *name;
+	const char *usage;
+	const char *help;
+	SHELL_Handler handler;
+} SHELL_Command;
+
+void SHELL_Init(const SHELL_Command *commands, uint8_t count, SHELL_Output output);
+void SHELL_Input(uint8_t byte);
+void SHELL_InputBuffer(const uint8_t *data, uint32_t length);
+SHELL_Status SHELL_Execute(char *line);
+void SHELL_Printf(const char *format, ...) __attribute__((format(printf, 1, 2)));
+uint8_t SHELL_ParseUint(const char *text, uint32_t *value);
+
+#endif
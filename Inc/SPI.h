@@ -4,10 +4,65 @@
 #include <stddef.h>
 #include "stm32f4xx.h"
 
+// Transfers shorter than this are cheaper to poll than to set up DMA for
+#define SPI2_DMA_THRESHOLD	16
+
+// Fastest SCK SPI2 may run at, the prescaler is derived from PCLK1
+#define SPI2_MAX_SCK_HZ		21000000
+
+// Even-length polled transfers at least this long use 16-bit frames, 0 disables them
+#ifndef SPI_DFF16_MIN
+#define SPI_DFF16_MIN		8
+#endif
+
+// Polled reads mask interrupts for at most this many bytes at a time, must be even
+#ifndef SPI_READ_MASKED_BYTES
+#define SPI_READ_MASKED_BYTES	64
+#endif
+
+// BR[2:0] range, SCK = fPCLK / 2^(BR+1)
+#define SPI_BAUD_FASTEST	0
+#define SPI_BAUD_SLOWEST	7
+
+typedef void (*SPI2_DMA_Callback)(void);
+
+// Cycles each transfer path takes for the same buffer, see SPI2_Benchmark()
+typedef struct
+{
+	uint16_t size;
+	uint32_t exchangeCycles;	// Lockstep SPI2_TransmitReceive_MultiByte()
+	uint32_t writeCycles;		// TX-ahead write-only kernel
+	uint32_t readCycles;		// Pipelined read-only kernel
+	uint32_t dmaCycles;			// SPI2_DMA_TransmitReceive()
+} SPI2_BenchResult;
+
 void SPI2_Init(void);
 void SPI2_SelectSlave(void);
 void SPI2_DeselectSlave(void);
 uint8_t SPI2_TransmitReceiveByte(uint8_t data);
 void SPI2_TransmitReceive_MultiByte(uint8_t *txData, uint8_t *rxData, uint16_t size);
 
-#endif
\ No newline at end of file
+// DMA Functions
+uint8_t SPI2_DMA_Start(const uint8_t *txData, uint8_t *rxData, uint16_t size, SPI2_DMA_Callback callback);
+uint8_t SPI2_DMA_IsBusy(void);
+void SPI2_DMA_Wait(void);
+void SPI2_DMA_TransmitReceive(const uint8_t *txData, uint8_t *rxData, uint16_t size);
+void SPI2_Transfer(const uint8_t *txData, uint8_t *rxData, uint16_t size);
+
+// Polled Kernels
+void SPI2_Write(const uint8_t *txData, uint16_t size);
+void SPI2_Read(uint8_t *rxData, uint16_t size);
+uint32_t SPI2_RxOverruns(void);
+void SPI2_Benchmark(uint8_t *buffer, uint16_t size, SPI2_BenchResult *result);
+uint32_t SPI_BytesPerKiloCycle(uint16_t size, uint32_t cycles);
+
+// Instance Functions
+void SPI_InitChipSelect(GPIO_TypeDef *port, uint8_t pin);
+void SPI_SelectSlave(GPIO_TypeDef *port, uint8_t pin);
+void SPI_DeselectSlave(GPIO_TypeDef *port, uint8_t pin);
+uint8_t SPI_TransmitReceiveByte(SPI_TypeDef *spi, uint8_t data);
+void SPI_Transfer(SPI_TypeDef *spi, const uint8_t *txData, uint8_t *rxData, uint16_t size);
+uint8_t SPI_SetBaudRate(SPI_TypeDef *spi, uint8_t baudRate);
+uint8_t SPI_GetBaudRate(SPI_TypeDef *spi);
+
+#endif
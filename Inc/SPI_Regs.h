@@ -0,0 +1,26 @@
+#ifndef SPI_REGS_H_
+#define SPI_REGS_H_
+
+#include "stm32f4xx.h"
+
+/* Peripheral instances touched by SPI.c. A host build defines SPI_REG_MOCK
+ * and supplies RAM-backed register blocks through RegMock.h instead, so the
+ * DMA transfer path can run off-target. */
+#ifdef SPI_REG_MOCK
+#include "RegMock.h"
+#else
+#define SPI2_REGS				SPI2
+#define SPI2_GPIO				GPIOB
+#define SPI2_RCC				RCC
+#define SPI2_DMA				DMA1
+#define SPI2_DMA_RX_STREAM		DMA1_Stream3
+#define SPI2_DMA_TX_STREAM		DMA1_Stream4
+#define SPI2_DMA_ADDRESS(ptr)	((uint32_t)(ptr))
+#define SPI2_DMA_IRQ_ENABLE()	NVIC_EnableIRQ(DMA1_Stream3_IRQn)
+#define SPI2_DMA_POLL()			((void)0)
+#define SPI2_IRQ_SAVE()			__get_PRIMASK()
+#define SPI2_IRQ_DISABLE()		__disable_irq()
+#define SPI2_IRQ_RESTORE(state)	__set_PRIMASK(state)
+#endif
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef STRIPE_H_
+#define STRIPE_H_
+
+#include "W25Qxx.h"
+
+#define STRIPE_MAX_DEVICES	4
+
+// Logical blocks spread round-robin over several chips (RAID-0)
+typedef struct
+{
+	W25Q_Device *devices[STRIPE_MAX_DEVICES];
+	uint8_t deviceCount;
+	uint32_t blockSize;
+	uint32_t blockCount;
+} STRIPE_Volume;
+
+W25Q_Status STRIPE_Init(STRIPE_Volume *volume, W25Q_Device **devices, uint8_t deviceCount);
+uint32_t STRIPE_ByteCount(STRIPE_Volume *volume);
+W25Q_Status STRIPE_Read(STRIPE_Volume *volume, uint32_t address, uint8_t *buffer, uint32_t length);
+W25Q_Status STRIPE_Write(STRIPE_Volume *volume, uint32_t address, uint8_t *data, uint32_t length);
+W25Q_Status STRIPE_EraseBlocks(STRIPE_Volume *volume, uint32_t firstBlock, uint32_t blockCount);
+
+#endif
@@ -5,11 +5,52 @@
 #include "W25Qxx.h"
 
 #define TOTAL_BLOCKS 	128
+
+/* Metadata lives in the security registers: erase counts fill registers 1
+ * and 2, the block map takes the first TOTAL_BLOCKS bytes of register 3.
+ * Bytes W25Q_CAL_OFFSET to W25Q_CAL_OFFSET + W25Q_CAL_LENGTH of register 3
+ * are reserved for the driver's calibration pattern. SWAP_FS never writes
+ * them and restores them after every erase of register 3. */
 #define ROWS 			16
 #define COLUMNS 		8
 
+// Diagnostic output levels, SFS_LOG_NONE compiles out every printf
+#define SFS_LOG_NONE			0
+#define SFS_LOG_INFO			1
+#define SFS_LOG_CONSOLE			2
+
+#ifndef SFS_LOG_LEVEL
+#define SFS_LOG_LEVEL			SFS_LOG_CONSOLE
+#endif
+
+#if SFS_LOG_LEVEL >= SFS_LOG_INFO
+#define SFS_LOG(...)			printf(__VA_ARGS__)
+#else
+#define SFS_LOG(...)			((void)0)
+#endif
+
+// Erase-count gap at which a write moves to the least worn block, 0 never moves.
+// Keep it 0 on target until SWAP_FS tracks free blocks and wear per physical block.
+#ifndef SFS_SWAP_THRESHOLD
+#define SFS_SWAP_THRESHOLD		0
+#endif
+
+// Minimum time between two console updates, changes in between are batched
+#ifndef SFS_CONSOLE_INTERVAL_MS
+#define SFS_CONSOLE_INTERVAL_MS	100
+#endif
+
 void SFS_InitFS(void);
 void SFS_ReadFS(uint32_t *eraseCountArr, uint8_t *blockMapArr);
 void SFS_WriteData(uint32_t *eraseCountArr, uint8_t *blockMap, uint8_t blockNumber, uint8_t *data, uint32_t len);
+uint8_t SFS_SelectBlock(const uint32_t *eraseCountArr, uint8_t blockNumber);
+void SFS_RecordWrite(uint32_t *eraseCountArr, uint8_t *blockMap, uint8_t blockNumber, uint8_t physicalBlock);
+void SFS_Format(uint32_t *eraseCountArr, uint8_t *blockMapArr);
+void SFS_SetSwapThreshold(uint32_t threshold);
+uint32_t SFS_GetSwapThreshold(void);
+void SFS_RepaintConsole(uint32_t *eraseCountArr, uint8_t *blockMap);
+void SFS_SetConsoleInterval(uint32_t intervalMs);
+void SFS_SetDeferredReport(uint8_t enable);
+void SFS_Report(uint32_t *eraseCountArr, uint8_t *blockMap);
 
 #endif
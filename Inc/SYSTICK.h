@@ -1,8 +1,23 @@
 #ifndef SYSTICK_H_
 #define SYSTICK_H_
 
+#include <stddef.h>
 #include "stm32f4xx.h"
+#include "CLOCK.h"
 
+// Called from the tick interrupt once per millisecond
+typedef void (*tick_hook_t)(void);
+
+void tick_init(void);
+uint32_t get_ticks(void);
+uint32_t get_micros(void);
+uint32_t deadline_after(uint32_t ms);
+uint8_t deadline_expired(uint32_t deadline);
+void sleep_until(uint32_t deadline);
+void tick_set_hook(tick_hook_t hook);
 void delay_ms(uint32_t ms);
+void cycle_counter_init(void);
+uint32_t cycle_count(void);
+uint32_t cycles_to_us(uint32_t cycles);
 
 #endif
@@ -0,0 +1,44 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+#include <stdint.h>
+
+/* Binary event records, shared with the host decoder. Every record is
+ *	type (u8) | sequence (u8) | timestamp ms (u32) | payload | CRC-16 (u16)
+ * with multi-byte fields little-endian and the CRC over everything before
+ * it. Records are COBS-encoded and framed by 0x00 bytes on both sides. */
+
+// Build with -DTLM_AT_BOOT=1 to stream from power-up, otherwise use "set telemetry 1"
+#ifndef TLM_AT_BOOT
+#define TLM_AT_BOOT				0
+#endif
+
+#define TLM_HEADER_SIZE			6
+#define TLM_CRC_SIZE			2
+#define TLM_MAX_PAYLOAD			82
+#define TLM_MAX_RECORD			(TLM_HEADER_SIZE + TLM_MAX_PAYLOAD + TLM_CRC_SIZE)
+
+// Blocks per snapshot record, each one is an erase count (u32) and a map entry (u8)
+#define TLM_SNAPSHOT_BLOCKS		16
+
+typedef enum
+{
+	TLM_EVENT_MOUNT = 1,		// block count (u16), block size (u32)
+	TLM_EVENT_WRITE,			// logical block (u8), physical block (u8), length (u32)
+	TLM_EVENT_REMAP,			// logical block (u8), physical block (u8)
+	TLM_EVENT_ERASE_COUNT,		// block (u8), erase count (u32)
+	TLM_EVENT_SNAPSHOT			// first block (u8), count (u8), count x (erase count, map entry)
+} TLM_Event;
+
+// Sink for encoded frames, UART2_Write() on target
+typedef uint32_t (*TLM_Output)(const char *data, uint32_t length);
+
+void TLM_Init(TLM_Output output);
+uint8_t TLM_IsEnabled(void);
+void TLM_Mount(uint16_t blockCount, uint32_t blockSize);
+void TLM_Write(uint8_t logicalBlock, uint8_t physicalBlock, uint32_t length);
+void TLM_Remap(uint8_t logicalBlock, uint8_t physicalBlock);
+void TLM_EraseCount(uint8_t block, uint32_t eraseCount);
+void TLM_Snapshot(const uint32_t *eraseCountArr, const uint8_t *blockMap, uint16_t blockCount);
+
+#endif
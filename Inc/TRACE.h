@@ -0,0 +1,82 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+/* Opt-in access trace, shared with the host replayer. Build with
+ * -DTRACE_ENABLE=1 to record every SFS_WriteData() and every read, program
+ * and erase the W25Q driver issues into a RAM ring. The ring is dumped on
+ * demand, or in stream mode drained by TRACE_Poll() from the main loop, so
+ * the hooks never wait on the UART. Every record is
+ *	op (u8) | sequence (u8) | logical block (u8) | physical block (u8) |
+ *	timestamp us (u32) | address (u32) | length (u32)
+ * little-endian. Records leave the board like telemetry: the record and its
+ * CRC-16 COBS-encoded between 0x00 delimiters. With tracing disabled every
+ * call expands to nothing and no data is kept. */
+
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE			0
+#endif
+
+// Records kept by the RAM ring, TRACE_RECORD_SIZE bytes each
+#ifndef TRACE_RING_RECORDS
+#define TRACE_RING_RECORDS		256
+#endif
+
+// Most records one TRACE_Poll() call sends, bounds the time it takes
+#ifndef TRACE_POLL_RECORDS
+#define TRACE_POLL_RECORDS		8
+#endif
+
+#define TRACE_RECORD_SIZE		16
+#define TRACE_CRC_SIZE			2
+
+// Block field of records that do not belong to one
+#define TRACE_NO_BLOCK			0xFF
+
+typedef enum
+{
+	TRACE_OP_WRITE = 1,			// SFS_WriteData(): logical and chosen physical block, block address, length
+	TRACE_OP_READ,				// Any array read: address, length
+	TRACE_OP_PROGRAM,			// Page program run: address, length
+	TRACE_OP_ERASE,				// Sector or block erase actually sent: address, size
+	TRACE_OP_SECURITY_ERASE		// Security register erase: register address
+} TRACE_Op;
+
+typedef enum
+{
+	TRACE_OFF = 0,
+	TRACE_RING,					// Keep the latest TRACE_RING_RECORDS, oldest overwritten
+	TRACE_STREAM				// Send records from the ring as TRACE_Poll() runs
+} TRACE_Mode;
+
+// Sink for encoded frames, UART2_Write() on target
+typedef uint32_t (*TRACE_Output)(const char *data, uint32_t length);
+
+#if TRACE_ENABLE
+
+void TRACE_Init(TRACE_Output output);
+void TRACE_SetMode(TRACE_Mode mode);
+TRACE_Mode TRACE_GetMode(void);
+void TRACE_Record(TRACE_Op op, uint8_t logicalBlock, uint8_t physicalBlock, uint32_t address, uint32_t length);
+void TRACE_Poll(void);
+uint32_t TRACE_Dump(void);
+void TRACE_Clear(void);
+uint32_t TRACE_Count(void);
+uint32_t TRACE_Overwritten(void);
+
+#else
+
+#define TRACE_Init(output)		((void)(output))
+#define TRACE_SetMode(mode)		((void)(mode))
+#define TRACE_GetMode()			TRACE_OFF
+#define TRACE_Record(op, logicalBlock, physicalBlock, address, length)	((void)0)
+#define TRACE_Poll()			((void)0)
+#define TRACE_Dump()			0
+#define TRACE_Clear()			((void)0)
+#define TRACE_Count()			0
+#define TRACE_Overwritten()		0
+
+#endif
+
+#endif
@@ -2,12 +2,49 @@
 #define UART_H_
 
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include "stm32f4xx.h"
 
+// Size of the transmit ring buffer, must be a power of two
+#ifndef UART2_TX_BUFFER_SIZE
+#define UART2_TX_BUFFER_SIZE	2048
+#endif
+
+// 1 drains the ring with DMA1 Stream 6, 0 with the TXE interrupt
+#ifndef UART2_TX_DMA
+#define UART2_TX_DMA			1
+#endif
+
+// Size of the receive ring buffer, must be a power of two
+#ifndef UART2_RX_BUFFER_SIZE
+#define UART2_RX_BUFFER_SIZE	128
+#endif
+
+// Longest DMA transfer, bounds how long a chunk holds its part of the ring
+#define UART2_TX_DMA_CHUNK		64
+
+// What UART2_Write() does when the ring buffer is full
+typedef enum
+{
+	UART_OVERFLOW_BLOCK = 0,	// Wait for the transmitter to make room
+	UART_OVERFLOW_DROP,			// Discard the bytes that do not fit
+	UART_OVERFLOW_OVERWRITE		// Discard the oldest bytes not yet sent
+} UART_OverflowPolicy;
+
 void UART2_Init(void);
 void UART2_TxChar(char ch);
 void UART2_TxString(char *str);
 uint8_t UART2_RxChar(void);
 
-#endif
+// Buffered Transmit Functions
+uint32_t UART2_Write(const char *data, uint32_t length);
+void UART2_Flush(void);
+void UART2_SetOverflowPolicy(UART_OverflowPolicy policy);
+uint32_t UART2_DroppedBytes(void);
 
+// Buffered Receive Functions
+uint8_t UART2_ReadByte(uint8_t *byte);
+uint32_t UART2_RxOverruns(void);
+
+#endif
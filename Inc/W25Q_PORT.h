@@ -0,0 +1,35 @@
+#ifndef W25Q_PORT_H_
+#define W25Q_PORT_H_
+
+#include <stdint.h>
+
+struct W25Q_Device;
+
+/* Everything the W25Q driver needs from the board, as a table of functions
+ * each device points at. The command logic in W25Qxx.c only goes through
+ * this table, so the same driver runs on SPI2 with DMA, on another SPI
+ * instance, or against the host simulator. */
+typedef struct
+{
+	// Sets up the bus and chip select of the device, called by W25Q_InitDevice()
+	void (*init)(struct W25Q_Device *device);
+	void (*select)(struct W25Q_Device *device);
+	void (*deselect)(struct W25Q_Device *device);
+	uint8_t (*transfer)(struct W25Q_Device *device, uint8_t data);
+	// Either buffer may be NULL: 0xFF is sent, received bytes are dropped
+	void (*bulk)(struct W25Q_Device *device, const uint8_t *txData, uint8_t *rxData, uint16_t size);
+	// Optional background read and its wait, NULL if the bus cannot overlap
+	void (*bulkStart)(struct W25Q_Device *device, uint8_t *rxData, uint16_t size);
+	void (*bulkWait)(struct W25Q_Device *device);
+	// Applies a clock divider (SPI BR[2:0] on target), returns the one in effect
+	uint8_t (*setBaudRate)(struct W25Q_Device *device, uint8_t baudRate);
+	// Sleeps until something may have changed, at most until the next tick
+	void (*wait)(void);
+	uint32_t (*millis)(void);
+	uint32_t (*micros)(void);
+} W25Q_Port;
+
+// SPI port on target, the simulator on the host, chosen at link time
+extern const W25Q_Port W25Q_DefaultPort;
+
+#endif
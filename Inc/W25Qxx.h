@@ -3,8 +3,10 @@
 
 #include "SPI.h"
 #include "SYSTICK.h"
+#include "CRC.h"
+#include "W25Q_PORT.h"
 
-// Flash Memory Parameter macros
+// Flash Memory Parameter macros (W25Q64, used until SFDP says otherwise)
 #define W25Q_ByteCount		8388608
 #define W25Q_PageSize		256
 #define W25Q_PageCount		32768
@@ -13,11 +15,37 @@
 #define W25Q_BlockSize		65536
 #define W25Q_BlockCount		128
 
+// Size of the per-device erased-sector bitmap, sectors beyond it are never elided
+#ifndef W25Q_MAX_SECTOR_COUNT
+#define W25Q_MAX_SECTOR_COUNT	W25Q_SectorCount
+#endif
+
+// Largest page callers need to buffer, SFDP may report a smaller one
+#ifndef W25Q_MAX_PAGE_SIZE
+#define W25Q_MAX_PAGE_SIZE		W25Q_PageSize
+#endif
+
 // Security Register Address macros
 #define SECURITY_REG_1		0x001000
 #define SECURITY_REG_2		0x002000
 #define SECURITY_REG_3		0x003000
 
+// Addresses above this need 4-byte address mode
+#define W25Q_3BYTE_LIMIT	16777216
+
+// Baud-rate calibration macros: the test pattern lives in the upper half
+// of security register 3, the lower half belongs to the file system
+#define W25Q_CAL_REG			3
+#define W25Q_CAL_OFFSET			128
+#define W25Q_CAL_LENGTH			128
+#define W25Q_CAL_REPEATS		8
+#define W25Q_CAL_FAILURE_LIMIT	3
+#define W25Q_BAUD_UNSET			0xFF
+
+// SFDP macros
+#define W25Q_SFDP_SIGNATURE		0x50444653
+#define W25Q_SFDP_MAX_DWORDS	16
+
 // Flash Memory Command macros
 #define ENABLE_RESET		0x66
 #define EXECUTE_RESET		0x99
@@ -36,10 +64,182 @@
 #define POWER_UP			0xAB
 #define READ_STATUS_R1		0x05
 #define READ_STATUS_R2		0x35
+#define READ_STATUS_R3		0x15
 #define WRITE_STATUS_REG	0x01
 #define READ_SECURITY_REG	0x48
 #define WRITE_SECURITY_REG	0x42
 #define ERASE_SECURITY_REG	0x44
+#define SUSPEND				0x75
+#define RESUME				0x7A
+#define READ_SFDP			0x5A
+#define ENTER_4BYTE_MODE	0xB7
+
+// Status Register bit macros
+#define SR1_BUSY			0x01
+#define SR1_WEL				0x02
+#define SR2_SUS				0x80
+#define SR3_ADS				0x01
+
+// Suspend/Resume timing macros in microseconds
+#define W25Q_TSUS_US			20
+#define W25Q_RESUME_TO_SUSPEND_US	200
+
+// Operation timeout macros in milliseconds (datasheet maximums)
+#define W25Q_TIMEOUT_PAGE_PROGRAM	3
+#define W25Q_TIMEOUT_STATUS_WRITE	15
+#define W25Q_TIMEOUT_SECTOR_ERASE	400
+#define W25Q_TIMEOUT_32KBLOCK_ERASE	1600
+#define W25Q_TIMEOUT_64KBLOCK_ERASE	2000
+#define W25Q_TIMEOUT_CHIP_ERASE		100000
+
+// Waits on operations with at least this timeout sleep between polls
+#define W25Q_SLEEP_MIN_MS			10
+
+// Erase time macros in milliseconds (datasheet typicals)
+#define W25Q_TYPICAL_SECTOR_ERASE	45
+#define W25Q_TYPICAL_32KBLOCK_ERASE	120
+#define W25Q_TYPICAL_64KBLOCK_ERASE	150
+
+// Driver return codes
+typedef enum
+{
+	W25Q_OK = 0,
+	W25Q_ERROR_TIMEOUT,
+	W25Q_ERROR_WEL,
+	W25Q_ERROR_PARAM,
+	W25Q_ERROR_BUSY,
+	W25Q_ERROR_LINK
+} W25Q_Status;
+
+// State of the pending asynchronous program/erase operation
+typedef enum
+{
+	W25Q_ASYNC_IDLE = 0,
+	W25Q_ASYNC_BUSY,
+	W25Q_ASYNC_DONE,
+	W25Q_ASYNC_ERROR
+} W25Q_AsyncState;
+
+// Open FAST_READ transaction, see W25Q_StreamOpen()
+typedef struct
+{
+	uint32_t address;
+	uint32_t remaining;
+	uint8_t open;
+	uint8_t resume;
+} W25Q_Stream;
+
+// Receives each chunk of a streamed read, returns 0 to stop the stream early
+typedef uint8_t (*W25Q_StreamCallback)(const uint8_t *chunk, uint32_t length, void *context);
+
+// Typical erase time of each granularity, used by the erase-range planner
+typedef struct
+{
+	uint32_t sectorEraseMs;
+	uint32_t block32kEraseMs;
+	uint32_t block64kEraseMs;
+} W25Q_EraseTiming;
+
+// One erase command chosen by the erase-range planner
+typedef struct
+{
+	uint8_t command;
+	uint32_t address;
+	uint32_t size;
+	uint32_t costMs;
+} W25Q_EraseStep;
+
+// Program/erase operation currently owned by a chip
+typedef struct
+{
+	volatile W25Q_AsyncState state;
+	W25Q_Status result;
+	uint32_t deadline;
+	uint32_t timeoutMs;
+	// Pages still to be programmed by a multi-page write
+	uint32_t page;
+	uint16_t offset;
+	uint32_t remaining;
+	uint8_t *data;
+	// Region of the main array being erased, eraseSize is 0 for programs
+	uint32_t eraseAddress;
+	uint32_t eraseSize;
+	uint8_t suspendable;
+	uint8_t suspended;
+} W25Q_Job;
+
+// One W25Q chip: its bus, geometry and driver state
+typedef struct W25Q_Device
+{
+	const W25Q_Port *port;
+	// Bus and chip select, used by the STM32 port
+	SPI_TypeDef *spi;
+	GPIO_TypeDef *csPort;
+	uint8_t csPin;
+	// Calibrated SPI prescaler and consecutive CRC failures reported since
+	uint8_t baudRate;
+	uint8_t crcFailures;
+	uint32_t byteCount;
+	uint32_t pageSize;
+	uint32_t sectorSize;
+	uint32_t blockSize;
+	uint8_t addressBytes;
+	uint8_t sectorEraseCommand;
+	uint8_t block32kEraseCommand;
+	uint8_t block64kEraseCommand;
+	W25Q_EraseTiming eraseTiming;
+	// Maximum erase times, used as operation timeouts
+	W25Q_EraseTiming eraseTimeout;
+	uint32_t chipEraseTimeoutMs;
+	W25Q_Job job;
+	uint8_t readPriority;
+	// Set while a stream holds CS low, other driver calls are refused until it closes
+	uint8_t streamOpen;
+	uint32_t lastResumeUs;
+	// One bit per sector, set while the sector is known to read back as 0xFF
+	uint32_t erasedMap[W25Q_MAX_SECTOR_COUNT / 32];
+} W25Q_Device;
+
+// Static initialiser for a W25Q64 on the given SPI instance and CS pin,
+// W25Q_InitDevice() replaces the geometry and timing with the SFDP values
+#define W25Q_DEVICE_INIT(spiInstance, gpio, pin)	\
+{													\
+	.port = &W25Q_DefaultPort,						\
+	.spi = (spiInstance),							\
+	.csPort = (gpio),								\
+	.csPin = (pin),									\
+	.baudRate = W25Q_BAUD_UNSET,					\
+	.byteCount = W25Q_ByteCount,					\
+	.pageSize = W25Q_PageSize,						\
+	.sectorSize = W25Q_SectorSize,					\
+	.blockSize = W25Q_BlockSize,					\
+	.addressBytes = 3,								\
+	.sectorEraseCommand = ERASE_SECTOR,				\
+	.block32kEraseCommand = ERASE_32KBLOCK,			\
+	.block64kEraseCommand = ERASE_64KBLOCK,			\
+	.eraseTiming =									\
+	{												\
+		W25Q_TYPICAL_SECTOR_ERASE,					\
+		W25Q_TYPICAL_32KBLOCK_ERASE,				\
+		W25Q_TYPICAL_64KBLOCK_ERASE					\
+	},												\
+	.eraseTimeout =									\
+	{												\
+		W25Q_TIMEOUT_SECTOR_ERASE,					\
+		W25Q_TIMEOUT_32KBLOCK_ERASE,				\
+		W25Q_TIMEOUT_64KBLOCK_ERASE					\
+	},												\
+	.chipEraseTimeoutMs = W25Q_TIMEOUT_CHIP_ERASE	\
+}
+
+// Device Functions
+void W25Q_InitDevice(W25Q_Device *device);
+void W25Q_SelectDevice(W25Q_Device *device);
+W25Q_Device *W25Q_GetDevice(void);
+W25Q_Status W25Q_ReadSFDP(uint32_t address, uint8_t *buffer, uint16_t length);
+W25Q_Status W25Q_Configure(void);
+W25Q_Status W25Q_Calibrate(void);
+W25Q_Status W25Q_ReportCrc(uint8_t passed);
 
 // Control Functions
 void W25Q_Init(void);
@@ -51,24 +251,55 @@ uint32_t W25Q_ReadUID(void);
 // Status Register Functions
 uint8_t W25Q_ReadStatusRegister1(void);
 uint8_t W25Q_ReadStatusRegister2(void);
-void W25Q_WriteStatusRegister(uint8_t statusReg1, uint8_t statusReg2);
+uint8_t W25Q_ReadStatusRegister3(void);
+W25Q_Status W25Q_WriteStatusRegister(uint8_t statusReg1, uint8_t statusReg2);
+W25Q_Status W25Q_WaitReady(uint32_t timeoutMs);
 
 // Security Register Functions
-void W25Q_WriteSecurityRegister(uint8_t securityReg, uint8_t offset, uint8_t *data, uint16_t len);
-void W25Q_ReadSecurityRegister(uint8_t securityReg, uint8_t offset, uint8_t *data, uint16_t len);
-void W25Q_EraseSecurityRegister(uint8_t securityReg);
+W25Q_Status W25Q_WriteSecurityRegister(uint8_t securityReg, uint8_t offset, uint8_t *data, uint16_t len);
+W25Q_Status W25Q_ReadSecurityRegister(uint8_t securityReg, uint8_t offset, uint8_t *data, uint16_t len);
+W25Q_Status W25Q_EraseSecurityRegister(uint8_t securityReg);
 
 // Read Functions
 void W25Q_ReadData(uint32_t startPage, uint8_t offset, uint8_t *buffer, uint16_t length);
 void W25Q_FastReadData(uint32_t startPage, uint8_t offset, uint8_t *buffer, uint16_t length);
+W25Q_Status W25Q_StreamOpen(W25Q_Stream *stream, uint32_t memAddress, uint32_t length);
+uint32_t W25Q_StreamRead(W25Q_Stream *stream, uint8_t *buffer, uint32_t length);
+void W25Q_StreamClose(W25Q_Stream *stream);
+W25Q_Status W25Q_ReadStream(uint32_t memAddress, uint32_t length, uint8_t *chunk, uint32_t chunkSize,
+							W25Q_StreamCallback callback, void *context);
 
 // Write Functions
-void W25Q_WriteData(uint32_t startPage, uint16_t offset, uint32_t size, uint8_t *data);
+W25Q_Status W25Q_WriteData(uint32_t startPage, uint16_t offset, uint32_t size, uint8_t *data);
 
 // Erase Functions
-void W25Q_EraseSector(uint8_t blockNumber, uint8_t sectorNumber);
-void W25Q_Erase32kBlock(uint8_t blockNumber, uint8_t half);
-void W25Q_Erase64kBlock(uint8_t blockNumber);
-void W25Q_EraseChip(void);
+W25Q_Status W25Q_EraseSector(uint32_t blockNumber, uint8_t sectorNumber);
+W25Q_Status W25Q_Erase32kBlock(uint32_t blockNumber, uint8_t half);
+W25Q_Status W25Q_Erase64kBlock(uint32_t blockNumber);
+W25Q_Status W25Q_EraseChip(void);
+W25Q_Status W25Q_EraseRange(uint32_t memAddress, uint32_t length);
+uint32_t W25Q_EstimateEraseRange(uint32_t memAddress, uint32_t length);
+void W25Q_PlanEraseStep(uint32_t memAddress, uint32_t endAddress, W25Q_EraseStep *step);
+void W25Q_SetEraseTiming(const W25Q_EraseTiming *timing);
+
+// Blank Check Functions
+uint8_t W25Q_BlankCheck(uint32_t memAddress, uint32_t length);
+uint32_t W25Q_ScanErased(uint32_t memAddress, uint32_t length);
+
+// Asynchronous Program/Erase Functions, W25Q_ERROR_BUSY until W25Q_Complete() collected the last one
+W25Q_Status W25Q_WritePageAsync(uint32_t page, uint16_t offset, uint32_t size, uint8_t *data);
+W25Q_Status W25Q_WriteDataAsync(uint32_t startPage, uint16_t offset, uint32_t size, uint8_t *data);
+W25Q_Status W25Q_EraseSectorAsync(uint32_t blockNumber, uint8_t sectorNumber);
+W25Q_Status W25Q_Erase32kBlockAsync(uint32_t blockNumber, uint8_t half);
+W25Q_Status W25Q_Erase64kBlockAsync(uint32_t blockNumber);
+W25Q_Status W25Q_EraseChipAsync(void);
+W25Q_AsyncState W25Q_Poll(void);
+W25Q_Status W25Q_Complete(void);
+
+// Suspend/Resume Functions
+W25Q_Status W25Q_Suspend(void);
+W25Q_Status W25Q_Resume(void);
+uint8_t W25Q_IsSuspended(void);
+void W25Q_SetReadPriority(uint8_t enable);
 
 #endif
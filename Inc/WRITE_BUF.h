@@ -0,0 +1,27 @@
+#ifndef WRITE_BUF_H_
+#define WRITE_BUF_H_
+
+#include "W25Qxx.h"
+
+// Gathers small sequential writes into whole page programs of the selected device
+typedef struct
+{
+	uint8_t page[W25Q_MAX_PAGE_SIZE];
+	uint32_t pageNumber;
+	uint16_t start;
+	uint16_t end;
+	// get_ticks() of the last buffered write, partial pages age from it
+	uint32_t lastWriteMs;
+	uint32_t timeoutMs;
+	// Page fragments written by callers and page programs actually issued
+	uint32_t fragments;
+	uint32_t pagePrograms;
+} WBUF_Buffer;
+
+void WBUF_Init(WBUF_Buffer *buffer, uint32_t timeoutMs);
+W25Q_Status WBUF_Write(WBUF_Buffer *buffer, uint32_t memAddress, const uint8_t *data, uint32_t length);
+W25Q_Status WBUF_Sync(WBUF_Buffer *buffer);
+W25Q_Status WBUF_Poll(WBUF_Buffer *buffer);
+uint32_t WBUF_ProgramsAvoided(WBUF_Buffer *buffer);
+
+#endif
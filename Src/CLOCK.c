@@ -0,0 +1,110 @@
+#include "CLOCK.h"
+
+// HSI / 16 * 336 / 4 = 84 MHz, PLLQ = 48 MHz, APB1 = 42 MHz, APB2 = 84 MHz
+static const CLOCK_Config defaultConfig =
+{
+	.pllM = 16,
+	.pllN = 336,
+	.pllP = 4,
+	.pllQ = 7,
+	.ahbDivider = 1,
+	.apb1Divider = 2,
+	.apb2Divider = 1,
+	.flashLatency = 2
+};
+
+// Reset state: everything runs straight from the HSI
+static CLOCK_Tree clockTree = {CLOCK_HSI_HZ, CLOCK_HSI_HZ, CLOCK_HSI_HZ, CLOCK_HSI_HZ};
+
+static uint32_t CLOCK_Log2(uint32_t value)
+{
+	uint32_t log = 0;
+
+	while(value > 1)
+	{
+		value >>= 1;
+		log++;
+	}
+	return log;
+}
+
+// HPRE encodes /2 to /512 as 0b1000 to 0b1111, skipping /32
+static uint32_t CLOCK_AhbBits(uint32_t divider)
+{
+	uint32_t log = CLOCK_Log2(divider);
+
+	if(log == 0)
+	{
+		return 0;
+	}
+	return (log > 5) ? (log + 6) : (log + 7);
+}
+
+// PPRE1/PPRE2 encode /2 to /16 as 0b100 to 0b111
+static uint32_t CLOCK_ApbBits(uint32_t divider)
+{
+	uint32_t log = CLOCK_Log2(divider);
+
+	return (log == 0) ? 0 : (log + 3);
+}
+
+/**
+ * @brief	Brings the core up to 84 MHz through the PLL
+ */
+void CLOCK_Init(void)
+{
+	CLOCK_Configure(&defaultConfig);
+}
+
+/**
+ * @brief	Switches SYSCLK to the PLL with the given dividers and records the
+ * 			resulting bus frequencies. Drivers initialised afterwards derive
+ * 			their baud rates and reload values from CLOCK_Get().
+ * @param	config	PLL, bus divider and flash latency settings
+ */
+void CLOCK_Configure(const CLOCK_Config *config)
+{
+	// Regulator scale 2 allows up to 84 MHz
+	RCC->APB1ENR |= RCC_APB1ENR_PWREN;
+	PWR->CR = (PWR->CR & ~PWR_CR_VOS) | PWR_CR_VOS_1;
+
+	RCC->CR |= RCC_CR_HSION;
+	while(!(RCC->CR & RCC_CR_HSIRDY));
+
+	// Run from the HSI while the PLL is reprogrammed
+	RCC->CFGR &= ~RCC_CFGR_SW;
+	while((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSI);
+	RCC->CR &= ~RCC_CR_PLLON;
+	while(RCC->CR & RCC_CR_PLLRDY);
+
+	// Wait states must be raised before the clock goes up
+	FLASH->ACR = FLASH_ACR_PRFTEN | FLASH_ACR_ICEN | FLASH_ACR_DCEN | (config->flashLatency & FLASH_ACR_LATENCY);
+	while((FLASH->ACR & FLASH_ACR_LATENCY) != (config->flashLatency & FLASH_ACR_LATENCY));
+
+	RCC->PLLCFGR = RCC_PLLCFGR_PLLSRC_HSI |
+				   (config->pllM << RCC_PLLCFGR_PLLM_Pos) |
+				   (config->pllN << RCC_PLLCFGR_PLLN_Pos) |
+				   (((config->pllP / 2) - 1) << RCC_PLLCFGR_PLLP_Pos) |
+				   (config->pllQ << RCC_PLLCFGR_PLLQ_Pos);
+
+	RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2)) |
+				(CLOCK_AhbBits(config->ahbDivider) << RCC_CFGR_HPRE_Pos) |
+				(CLOCK_ApbBits(config->apb1Divider) << RCC_CFGR_PPRE1_Pos) |
+				(CLOCK_ApbBits(config->apb2Divider) << RCC_CFGR_PPRE2_Pos);
+
+	RCC->CR |= RCC_CR_PLLON;
+	while(!(RCC->CR & RCC_CR_PLLRDY));
+
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_PLL;
+	while((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_PLL);
+
+	clockTree.sysclkHz = ((CLOCK_HSI_HZ / config->pllM) * config->pllN) / config->pllP;
+	clockTree.hclkHz = clockTree.sysclkHz / config->ahbDivider;
+	clockTree.pclk1Hz = clockTree.hclkHz / config->apb1Divider;
+	clockTree.pclk2Hz = clockTree.hclkHz / config->apb2Divider;
+}
+
+const CLOCK_Tree *CLOCK_Get(void)
+{
+	return &clockTree;
+}
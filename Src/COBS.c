@@ -0,0 +1,67 @@
+#include "COBS.h"
+
+/**
+ * @brief	Consistent Overhead Byte Stuffing: removes every 0x00 from the
+ * 			input so 0x00 can delimit frames on the wire
+ * @param	input	Bytes to encode
+ * @param	length	Number of bytes
+ * @param	output	Buffer of at least COBS_MAX_ENCODED(length) bytes
+ * @return	Encoded length, the delimiter is not included
+ */
+uint32_t COBS_Encode(const uint8_t *input, uint32_t length, uint8_t *output)
+{
+	uint32_t codeIndex = 0;
+	uint32_t outIndex = 1;
+	uint8_t code = 1;
+
+	for(uint32_t i = 0; i < length; i++)
+	{
+		if(input[i] != 0)
+		{
+			output[outIndex++] = input[i];
+			code++;
+		}
+		// A zero, or a full block of 254 non-zero bytes, closes the block
+		if(input[i] == 0 || code == 0xFF)
+		{
+			output[codeIndex] = code;
+			code = 1;
+			codeIndex = outIndex++;
+		}
+	}
+	output[codeIndex] = code;
+	return outIndex;
+}
+
+/**
+ * @brief	Reverses COBS_Encode()
+ * @param	input	Encoded bytes, without the delimiter
+ * @param	length	Number of encoded bytes
+ * @param	output	Buffer of at least length bytes
+ * @return	Decoded length, 0 if the input is malformed
+ */
+uint32_t COBS_Decode(const uint8_t *input, uint32_t length, uint8_t *output)
+{
+	uint32_t inIndex = 0;
+	uint32_t outIndex = 0;
+	uint8_t code;
+
+	while(inIndex < length)
+	{
+		code = input[inIndex++];
+		if(code == 0 || (inIndex + code - 1) > length)
+		{
+			return 0;
+		}
+		for(uint8_t i = 1; i < code; i++)
+		{
+			output[outIndex++] = input[inIndex++];
+		}
+		// Every block but a full one or the last stood for a zero
+		if(code != 0xFF && inIndex < length)
+		{
+			output[outIndex++] = 0;
+		}
+	}
+	return outIndex;
+}
@@ -0,0 +1,328 @@
+#include <string.h>
+#include "COMMANDS.h"
+#include "UART.h"
+#include "SWAP_FS.h"
+#include "PROFILE.h"
+#include "TRACE.h"
+#include "TELEMETRY.h"
+
+// File-system tables the commands inspect, owned by main()
+static uint32_t *cmdEraseCount;
+static uint8_t *cmdBlockMap;
+
+static uint8_t benchBuffer[CMD_BENCH_CHUNK];
+
+static uint32_t CMD_KiBPerSecond(uint32_t bytes, uint32_t us)
+{
+	if(us == 0)
+	{
+		return 0;
+	}
+	return (uint32_t)(((uint64_t)bytes * 1000000) / ((uint64_t)us * 1024));
+}
+
+static void CMD_ReportRate(const char *name, uint32_t bytes, uint32_t us)
+{
+	SHELL_Printf("%s %lu B in %lu us, %lu KiB/s\r\n", name, bytes, us, CMD_KiBPerSecond(bytes, us));
+}
+
+/**
+ * @brief	Parses the block argument of a benchmark
+ * @return	1 if argv holds a block inside the device
+ */
+static uint8_t CMD_ParseBlock(const char *text, uint32_t *block)
+{
+	W25Q_Device *device = W25Q_GetDevice();
+
+	return SHELL_ParseUint(text, block) && *block < (device->byteCount / device->blockSize);
+}
+
+static SHELL_Status CMD_BenchRead(uint32_t block)
+{
+	W25Q_Device *device = W25Q_GetDevice();
+	uint32_t address = block * device->blockSize;
+	uint32_t start = get_micros();
+
+	for(uint32_t done = 0; done < device->blockSize; done += CMD_BENCH_CHUNK)
+	{
+		W25Q_FastReadData((address + done) / device->pageSize, 0, benchBuffer, CMD_BENCH_CHUNK);
+	}
+	CMD_ReportRate("read", device->blockSize, get_micros() - start);
+	return SHELL_OK;
+}
+
+static SHELL_Status CMD_BenchProgram(uint32_t block)
+{
+	W25Q_Device *device = W25Q_GetDevice();
+	uint32_t address = block * device->blockSize;
+	uint32_t start;
+
+	// Only the programming is timed, the block is erased beforehand
+	if(W25Q_Erase64kBlock(block) != W25Q_OK)
+	{
+		SHELL_Printf("erase failed\r\n");
+		return SHELL_FAILED;
+	}
+	for(uint32_t i = 0; i < CMD_BENCH_CHUNK; i++)
+	{
+		benchBuffer[i] = i;
+	}
+	start = get_micros();
+	for(uint32_t done = 0; done < device->blockSize; done += CMD_BENCH_CHUNK)
+	{
+		if(W25Q_WriteData((address + done) / device->pageSize, 0, CMD_BENCH_CHUNK, benchBuffer) != W25Q_OK)
+		{
+			SHELL_Printf("program failed at 0x%06lx\r\n", address + done);
+			return SHELL_FAILED;
+		}
+	}
+	CMD_ReportRate("program", device->blockSize, get_micros() - start);
+	return SHELL_OK;
+}
+
+static SHELL_Status CMD_BenchErase(uint32_t block)
+{
+	W25Q_Device *device = W25Q_GetDevice();
+	uint32_t start = get_micros();
+
+	if(W25Q_Erase64kBlock(block) != W25Q_OK)
+	{
+		SHELL_Printf("erase failed\r\n");
+		return SHELL_FAILED;
+	}
+	CMD_ReportRate("erase", device->blockSize, get_micros() - start);
+	return SHELL_OK;
+}
+
+/**
+ * @brief	bench read|program|erase <block>: times one 64 KB block.
+ * 			program and erase destroy the block's contents.
+ */
+static SHELL_Status CMD_Bench(int argc, char **argv)
+{
+	uint32_t block;
+
+	if(argc != 3 || !CMD_ParseBlock(argv[2], &block))
+	{
+		return SHELL_USAGE;
+	}
+	if(strcmp(argv[1], "read") == 0)
+	{
+		return CMD_BenchRead(block);
+	}
+	if(strcmp(argv[1], "program") == 0)
+	{
+		return CMD_BenchProgram(block);
+	}
+	if(strcmp(argv[1], "erase") == 0)
+	{
+		return CMD_BenchErase(block);
+	}
+	return SHELL_USAGE;
+}
+
+static SHELL_Status CMD_Stats(int argc, char **argv)
+{
+	W25Q_Device *device = W25Q_GetDevice();
+
+	(void)argv;
+	if(argc != 1)
+	{
+		return SHELL_USAGE;
+	}
+	SHELL_Printf("flash id 0x%06lx, %lu bytes, %u-byte addresses\r\n",
+				 W25Q_ReadID(), device->byteCount, device->addressBytes);
+	SHELL_Printf("spi prescaler %u, crc failures %u, rx overruns %lu\r\n",
+				 device->baudRate, device->crcFailures, SPI2_RxOverruns());
+	SHELL_Printf("uart dropped %lu, overruns %lu\r\n", UART2_DroppedBytes(), UART2_RxOverruns());
+	SHELL_Printf("uptime %lu ms, swap threshold %lu\r\n", get_ticks(), SFS_GetSwapThreshold());
+	PROFILE_Dump();
+	return SHELL_OK;
+}
+
+static void CMD_PrintTable(const char *title, const uint32_t *eraseCounts, const uint8_t *blockMap)
+{
+	SHELL_Printf("%s\r\n", title);
+	for(uint32_t row = 0; row < ROWS; row++)
+	{
+		SHELL_Printf("%3lu:", row * COLUMNS);
+		for(uint32_t column = 0; column < COLUMNS; column++)
+		{
+			uint32_t index = (row * COLUMNS) + column;
+
+			if(eraseCounts != NULL)
+			{
+				SHELL_Printf(" %10lu", eraseCounts[index]);
+			}
+			else
+			{
+				SHELL_Printf(" %3u", blockMap[index]);
+			}
+		}
+		SHELL_Printf("\r\n");
+	}
+}
+
+// wear: erase-count spread, then both tables as plain text
+static SHELL_Status CMD_Wear(int argc, char **argv)
+{
+	uint32_t lowest = UINT32_MAX;
+	uint32_t highest = 0;
+	uint64_t total = 0;
+
+	(void)argv;
+	if(argc != 1)
+	{
+		return SHELL_USAGE;
+	}
+	for(uint32_t i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		lowest = (cmdEraseCount[i] < lowest) ? cmdEraseCount[i] : lowest;
+		highest = (cmdEraseCount[i] > highest) ? cmdEraseCount[i] : highest;
+		total += cmdEraseCount[i];
+	}
+	SHELL_Printf("erase count min %lu, max %lu, mean %lu\r\n",
+				 lowest, highest, (uint32_t)(total / TOTAL_BLOCKS));
+	CMD_PrintTable("erase counts", cmdEraseCount, NULL);
+	CMD_PrintTable("block map", NULL, cmdBlockMap);
+	return SHELL_OK;
+}
+
+static SHELL_Status CMD_Format(int argc, char **argv)
+{
+	if(argc != 2 || strcmp(argv[1], "yes") != 0)
+	{
+		return SHELL_USAGE;
+	}
+	SFS_Format(cmdEraseCount, cmdBlockMap);
+	SHELL_Printf("formatted\r\n");
+	return SHELL_OK;
+}
+
+/**
+ * @brief	Switches the link between the text console and binary telemetry.
+ * 			A new stream starts with the mount record and the full tables,
+ * 			so tlm_decode can rebuild them from any capture.
+ */
+static void CMD_SetTelemetry(uint8_t enable)
+{
+	if(!enable)
+	{
+		TLM_Init(NULL);
+		return;
+	}
+	TLM_Init(UART2_Write);
+	TLM_Mount(TOTAL_BLOCKS, W25Q_BlockSize);
+	TLM_Snapshot(cmdEraseCount, cmdBlockMap, TOTAL_BLOCKS);
+}
+
+// set <name> <value>: runtime policy knobs
+static SHELL_Status CMD_Set(int argc, char **argv)
+{
+	uint32_t value;
+
+	if(argc != 3 || !SHELL_ParseUint(argv[2], &value))
+	{
+		return SHELL_USAGE;
+	}
+	if(strcmp(argv[1], "console") == 0)
+	{
+		SFS_SetConsoleInterval(value);
+	}
+	else if(strcmp(argv[1], "deferred") == 0)
+	{
+		SFS_SetDeferredReport(value != 0);
+	}
+	else if(strcmp(argv[1], "readprio") == 0)
+	{
+		W25Q_SetReadPriority(value != 0);
+	}
+	else if(strcmp(argv[1], "telemetry") == 0)
+	{
+		CMD_SetTelemetry(value != 0);
+	}
+	else
+	{
+		return SHELL_USAGE;
+	}
+	return SHELL_OK;
+}
+
+#if TRACE_ENABLE
+/**
+ * @brief	trace [off|ring|stream|dump|clear]: controls the access trace,
+ * 			without an argument prints its state
+ */
+static SHELL_Status CMD_Trace(int argc, char **argv)
+{
+	static const char *modeNames[] = { "off", "ring", "stream" };
+
+	if(argc == 1)
+	{
+		SHELL_Printf("trace %s, %lu records held, %lu overwritten\r\n",
+					 modeNames[TRACE_GetMode()], TRACE_Count(), TRACE_Overwritten());
+		return SHELL_OK;
+	}
+	if(argc != 2)
+	{
+		return SHELL_USAGE;
+	}
+	if(strcmp(argv[1], "dump") == 0)
+	{
+		// Frames are binary, the host tool skips the text around them
+		SHELL_Printf("dumped %lu records\r\n", TRACE_Dump());
+		return SHELL_OK;
+	}
+	if(strcmp(argv[1], "clear") == 0)
+	{
+		TRACE_Clear();
+		return SHELL_OK;
+	}
+	for(uint8_t mode = TRACE_OFF; mode <= TRACE_STREAM; mode++)
+	{
+		if(strcmp(argv[1], modeNames[mode]) == 0)
+		{
+			TRACE_SetMode(mode);
+			return SHELL_OK;
+		}
+	}
+	return SHELL_USAGE;
+}
+#endif
+
+static const SHELL_Command cmdTable[] =
+{
+	{ "bench",	"read|program|erase <block>",	"time one 64 KB block, program/erase destroy it",	CMD_Bench },
+	{ "stats",	NULL,							"driver, link and profiler statistics",			CMD_Stats },
+	{ "wear",	NULL,							"erase-count spread and wear tables",				CMD_Wear },
+	{ "format",	"yes",							"erase the file-system metadata",					CMD_Format },
+	{ "set",	"console|deferred|readprio|telemetry <value>",	"change a policy threshold",	CMD_Set },
+#if TRACE_ENABLE
+	{ "trace",	"[off|ring|stream|dump|clear]",	"record flash accesses for trace_replay",			CMD_Trace },
+#endif
+};
+
+/**
+ * @brief	Starts the command shell on USART2
+ * @param	eraseCountArr	Erase Count array the commands report and format
+ * @param	blockMap		Block Map array the commands report and format
+ */
+void CMD_Init(uint32_t *eraseCountArr, uint8_t *blockMap)
+{
+	cmdEraseCount = eraseCountArr;
+	cmdBlockMap = blockMap;
+	SHELL_Init(cmdTable, sizeof(cmdTable) / sizeof(cmdTable[0]), UART2_Write);
+}
+
+/**
+ * @brief	Hands every received byte to the shell, call it from the main loop
+ */
+void CMD_Poll(void)
+{
+	uint8_t byte;
+
+	while(UART2_ReadByte(&byte))
+	{
+		SHELL_Input(byte);
+	}
+}
@@ -0,0 +1,25 @@
+#include "CRC.h"
+
+// Polynomial 0x1021 applied to every 4-bit value, half a byte per lookup
+static const uint16_t crc16Nibble[16] =
+{
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+/**
+ * @brief	Adds bytes to a running CRC-16/CCITT-FALSE
+ * @param	crc		CRC16_INIT for a new message, or the previous result
+ * @param	data	Bytes to add
+ * @param	length	Number of bytes
+ * @return	Updated CRC
+ */
+uint16_t CRC16_Update(uint16_t crc, const uint8_t *data, uint32_t length)
+{
+	for(uint32_t i = 0; i < length; i++)
+	{
+		crc = (crc << 4) ^ crc16Nibble[(crc >> 12) ^ (data[i] >> 4)];
+		crc = (crc << 4) ^ crc16Nibble[(crc >> 12) ^ (data[i] & 0x0F)];
+	}
+	return crc;
+}
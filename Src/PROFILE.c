@@ -0,0 +1,145 @@
+#include "PROFILE.h"
+
+#if PROFILE_ENABLE
+
+#include <stdio.h>
+#include "SYSTICK.h"
+
+static PROFILE_TimeSource timeSource;
+static PROFILE_Entry *entries;
+
+// newlib-nano printf has no 64-bit conversions
+static const char *PROFILE_FormatU64(uint64_t value, char *buffer)
+{
+	char *digit = &buffer[20];
+
+	*digit = '\0';
+	do
+	{
+		*--digit = '0' + (value % 10);
+		value /= 10;
+	} while(value != 0);
+	return digit;
+}
+
+static uint8_t PROFILE_Log2(uint32_t value)
+{
+	uint8_t log = 0;
+
+	while(value > 1)
+	{
+		value >>= 1;
+		log++;
+	}
+	return log;
+}
+
+/**
+ * @brief	Starts recording with the given time source
+ * @param	source	Free-running timestamp function, NULL for the DWT
+ * 					cycle counter. Host builds pass a monotonic clock.
+ */
+void PROFILE_Init(PROFILE_TimeSource source)
+{
+	if(source == NULL)
+	{
+		cycle_counter_init();
+		source = cycle_count;
+	}
+	timeSource = source;
+}
+
+/**
+ * @brief	Clears the statistics of every function seen so far
+ */
+void PROFILE_Reset(void)
+{
+	for(PROFILE_Entry *entry = entries; entry != NULL; entry = entry->next)
+	{
+		entry->calls = 0;
+		entry->totalTime = 0;
+		entry->minTime = 0;
+		entry->maxTime = 0;
+		for(uint8_t bin = 0; bin < PROFILE_HISTOGRAM_BINS; bin++)
+		{
+			entry->histogram[bin] = 0;
+		}
+	}
+}
+
+PROFILE_Scope PROFILE_ScopeBegin(PROFILE_Entry *entry, const char *name)
+{
+	PROFILE_Scope scope = {NULL, 0};
+
+	// Nothing is recorded until PROFILE_Init() picks a time source
+	if(timeSource == NULL)
+	{
+		return scope;
+	}
+	if(entry->name == NULL)
+	{
+		entry->name = name;
+		entry->next = entries;
+		entries = entry;
+	}
+	scope.entry = entry;
+	scope.start = timeSource();
+	return scope;
+}
+
+void PROFILE_ScopeEnd(PROFILE_Scope *scope)
+{
+	PROFILE_Entry *entry = scope->entry;
+	uint32_t elapsed;
+
+	if(entry == NULL)
+	{
+		return;
+	}
+	elapsed = timeSource() - scope->start;
+
+	if(entry->calls == 0 || elapsed < entry->minTime)
+	{
+		entry->minTime = elapsed;
+	}
+	if(elapsed > entry->maxTime)
+	{
+		entry->maxTime = elapsed;
+	}
+	entry->calls++;
+	entry->totalTime += elapsed;
+	entry->histogram[PROFILE_Log2(elapsed)]++;
+}
+
+/**
+ * @brief	Prints one line per profiled function followed by its non-empty
+ * 			histogram bins as "log2:count"
+ */
+void PROFILE_Dump(void)
+{
+	char total[21];
+
+	printf("function,calls,total,min,max,mean\n\r");
+	for(PROFILE_Entry *entry = entries; entry != NULL; entry = entry->next)
+	{
+		if(entry->calls == 0)
+		{
+			continue;
+		}
+		printf("%s,%lu,%s,%lu,%lu,%lu\n\r", entry->name,
+			   (unsigned long)entry->calls, PROFILE_FormatU64(entry->totalTime, total),
+			   (unsigned long)entry->minTime, (unsigned long)entry->maxTime,
+			   (unsigned long)(entry->totalTime / entry->calls));
+		printf("  hist");
+		for(uint8_t bin = 0; bin < PROFILE_HISTOGRAM_BINS; bin++)
+		{
+			if(entry->histogram[bin] != 0)
+			{
+				printf(" %u:%lu", bin, (unsigned long)entry->histogram[bin]);
+			}
+		}
+		printf("\n\r");
+	}
+}
+
+#endif
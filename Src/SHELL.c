@@ -0,0 +1,280 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SHELL.h"
+
+#define KEY_CTRL_C		0x03
+#define KEY_BACKSPACE	0x08
+#define KEY_ESCAPE		0x1B
+#define KEY_DELETE		0x7F
+
+// Escape sequences (arrow keys and the like) are swallowed, not edited into the line
+typedef enum
+{
+	SHELL_STATE_TEXT = 0,
+	SHELL_STATE_ESCAPE,
+	SHELL_STATE_CSI
+} SHELL_State;
+
+static const SHELL_Command *shellCommands;
+static uint8_t shellCommandCount;
+static SHELL_Output shellOutput;
+
+static char line[SHELL_LINE_SIZE];
+static uint32_t lineLength;
+static uint8_t lineOverflow;
+static uint8_t lastWasCr;
+static SHELL_State inputState;
+
+static void SHELL_Write(const char *text, uint32_t length)
+{
+	if(shellOutput != NULL)
+	{
+		shellOutput(text, length);
+	}
+}
+
+static void SHELL_Puts(const char *text)
+{
+	SHELL_Write(text, strlen(text));
+}
+
+static void SHELL_Prompt(void)
+{
+	SHELL_Puts(SHELL_PROMPT);
+}
+
+static void SHELL_Help(void)
+{
+	SHELL_Printf("%-10s %s\r\n", "help", "list commands");
+	for(uint8_t i = 0; i < shellCommandCount; i++)
+	{
+		SHELL_Printf("%-10s %s\r\n", shellCommands[i].name, shellCommands[i].help);
+		if(shellCommands[i].usage != NULL)
+		{
+			SHELL_Printf("%-10s   %s %s\r\n", "", shellCommands[i].name, shellCommands[i].usage);
+		}
+	}
+}
+
+/**
+ * @brief	Splits a line into whitespace separated words, in place
+ * @return	Number of words stored in argv
+ */
+static int SHELL_Tokenize(char *text, char **argv)
+{
+	int argc = 0;
+
+	while(*text != '\0' && argc < SHELL_MAX_ARGS)
+	{
+		while(*text == ' ' || *text == '\t')
+		{
+			*text++ = '\0';
+		}
+		if(*text == '\0')
+		{
+			break;
+		}
+		argv[argc++] = text;
+		while(*text != '\0' && *text != ' ' && *text != '\t')
+		{
+			text++;
+		}
+	}
+	return argc;
+}
+
+/**
+ * @brief	Sets the command table and output, and prints the first prompt
+ * @param	commands	Command table, must outlive the shell
+ * @param	count		Number of entries in the table
+ * @param	output		Receives everything the shell prints, NULL discards it
+ */
+void SHELL_Init(const SHELL_Command *commands, uint8_t count, SHELL_Output output)
+{
+	shellCommands = commands;
+	shellCommandCount = count;
+	shellOutput = output;
+	lineLength = 0;
+	lineOverflow = 0;
+	lastWasCr = 0;
+	inputState = SHELL_STATE_TEXT;
+	SHELL_Prompt();
+}
+
+/**
+ * @brief	Feeds one received byte to the line editor. Printable bytes are
+ * 			echoed, backspace edits, CR or LF runs the line and Ctrl-C
+ * 			abandons it.
+ * @param	byte	Received byte
+ */
+void SHELL_Input(uint8_t byte)
+{
+	uint8_t crlf = lastWasCr && byte == '\n';
+
+	lastWasCr = (byte == '\r');
+	if(inputState == SHELL_STATE_ESCAPE)
+	{
+		inputState = (byte == '[') ? SHELL_STATE_CSI : SHELL_STATE_TEXT;
+		return;
+	}
+	if(inputState == SHELL_STATE_CSI)
+	{
+		// Parameters and intermediates run until a final byte in 0x40-0x7E
+		if(byte >= 0x40 && byte <= 0x7E)
+		{
+			inputState = SHELL_STATE_TEXT;
+		}
+		return;
+	}
+
+	switch(byte)
+	{
+	case '\r':
+	case '\n':
+		if(crlf)
+		{
+			break;
+		}
+		SHELL_Puts("\r\n");
+		if(lineOverflow)
+		{
+			SHELL_Printf("line longer than %u characters\r\n", SHELL_LINE_SIZE - 1);
+		}
+		else
+		{
+			line[lineLength] = '\0';
+			SHELL_Execute(line);
+		}
+		lineLength = 0;
+		lineOverflow = 0;
+		SHELL_Prompt();
+		break;
+	case KEY_BACKSPACE:
+	case KEY_DELETE:
+		if(lineLength > 0 && !lineOverflow)
+		{
+			lineLength--;
+			SHELL_Puts("\b \b");
+		}
+		break;
+	case KEY_CTRL_C:
+		SHELL_Puts("^C\r\n");
+		lineLength = 0;
+		lineOverflow = 0;
+		SHELL_Prompt();
+		break;
+	case KEY_ESCAPE:
+		inputState = SHELL_STATE_ESCAPE;
+		break;
+	default:
+		if(byte < ' ' || byte > '~')
+		{
+			break;
+		}
+		if(lineLength >= SHELL_LINE_SIZE - 1)
+		{
+			lineOverflow = 1;
+			break;
+		}
+		line[lineLength++] = byte;
+		SHELL_Write((const char *)&byte, 1);
+		break;
+	}
+}
+
+void SHELL_InputBuffer(const uint8_t *data, uint32_t length)
+{
+	for(uint32_t i = 0; i < length; i++)
+	{
+		SHELL_Input(data[i]);
+	}
+}
+
+/**
+ * @brief	Runs one command line without echo or prompt
+ * @param	text	Command line, modified in place
+ * @return	Handler result, SHELL_USAGE for an unknown command
+ */
+SHELL_Status SHELL_Execute(char *text)
+{
+	char *argv[SHELL_MAX_ARGS];
+	int argc = SHELL_Tokenize(text, argv);
+	SHELL_Status status;
+
+	if(argc == 0)
+	{
+		return SHELL_OK;
+	}
+	if(strcmp(argv[0], "help") == 0)
+	{
+		SHELL_Help();
+		return SHELL_OK;
+	}
+	for(uint8_t i = 0; i < shellCommandCount; i++)
+	{
+		if(strcmp(argv[0], shellCommands[i].name) != 0)
+		{
+			continue;
+		}
+		status = shellCommands[i].handler(argc, argv);
+		if(status == SHELL_USAGE)
+		{
+			SHELL_Printf("usage: %s %s\r\n", shellCommands[i].name,
+						 (shellCommands[i].usage != NULL) ? shellCommands[i].usage : "");
+		}
+		return status;
+	}
+	SHELL_Printf("unknown command '%s', try help\r\n", argv[0]);
+	return SHELL_USAGE;
+}
+
+/**
+ * @brief	Formats text to the shell output
+ */
+void SHELL_Printf(const char *format, ...)
+{
+	char buffer[SHELL_PRINT_SIZE];
+	va_list args;
+	int length;
+
+	va_start(args, format);
+	length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	if(length < 0)
+	{
+		return;
+	}
+	if(length >= (int)sizeof(buffer))
+	{
+		length = sizeof(buffer) - 1;
+	}
+	SHELL_Write(buffer, length);
+}
+
+/**
+ * @brief	Parses a decimal or 0x-prefixed hexadecimal argument
+ * @param	text	Argument text
+ * @param	value	Receives the value
+ * @return	1 if the whole argument was a number, 0 otherwise
+ */
+uint8_t SHELL_ParseUint(const char *text, uint32_t *value)
+{
+	char *end;
+	unsigned long parsed;
+
+	if(text == NULL || *text == '\0' || *text == '-')
+	{
+		return 0;
+	}
+	errno = 0;
+	parsed = strtoul(text, &end, 0);
+	if(*end != '\0' || errno == ERANGE || parsed > UINT32_MAX)
+	{
+		return 0;
+	}
+	*value = parsed;
+	return 1;
+}
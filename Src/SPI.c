@@ -1,4 +1,7 @@
 #include "SPI.h"
+#include "SPI_Regs.h"
+#include "CLOCK.h"
+#include "SYSTICK.h"
 
 /* SPI2 Pin Mapping
  *	SPI2_MOSI - PB15
@@ -7,49 +10,294 @@
  *	SPI2_NSS  - PB12
  */
 
+/* SPI2 DMA Mapping (DMA1, Channel 0)
+ *	SPI2_RX - Stream 3
+ *	SPI2_TX - Stream 4
+ */
+
+#define DMA_RX_FLAGS	(DMA_LIFCR_CTCIF3 | DMA_LIFCR_CHTIF3 | DMA_LIFCR_CTEIF3 | DMA_LIFCR_CDMEIF3 | DMA_LIFCR_CFEIF3)
+#define DMA_TX_FLAGS	(DMA_HIFCR_CTCIF4 | DMA_HIFCR_CHTIF4 | DMA_HIFCR_CTEIF4 | DMA_HIFCR_CDMEIF4 | DMA_HIFCR_CFEIF4)
+
+// Source of dummy bytes for RX-only transfers and sink for TX-only transfers
+static const uint8_t dmaDummyTx = 0xFF;
+static uint8_t dmaDummyRx;
+
+static volatile uint8_t dmaBusy;
+static uint32_t rxOverruns;
+static SPI2_DMA_Callback dmaCallback;
+
+// Route the CMSIS instances to the register blocks from SPI_Regs.h
+static SPI_TypeDef *SPI_Registers(SPI_TypeDef *spi)
+{
+	return (spi == SPI2) ? SPI2_REGS : spi;
+}
+
+static GPIO_TypeDef *SPI_GpioRegisters(GPIO_TypeDef *port)
+{
+	return (port == GPIOB) ? SPI2_GPIO : port;
+}
+
+/**
+ * @brief	Picks the smallest fPCLK / 2^(BR+1) divider that keeps SCK
+ * 			at or below the given frequency
+ * @return	BR[2:0] bits, already shifted into place for CR1
+ */
+static uint32_t SPI2_BaudRateBits(uint32_t pclkHz, uint32_t maxSckHz)
+{
+	uint32_t br = 0;
+
+	while(br < 7 && (pclkHz >> (br + 1)) > maxSckHz)
+	{
+		br++;
+	}
+	return (br << SPI_CR1_BR_Pos);
+}
+
+// DFF may only change while the peripheral is idle and disabled
+static void SPI_SetFrame16(SPI_TypeDef *regs, uint8_t enable)
+{
+	while(regs->SR & SPI_SR_BSY);
+	regs->CR1 &= ~SPI_CR1_SPE;
+	if(enable)
+	{
+		regs->CR1 |= SPI_CR1_DFF;
+	}
+	else
+	{
+		regs->CR1 &= ~SPI_CR1_DFF;
+	}
+	regs->CR1 |= SPI_CR1_SPE;
+}
+
+static uint8_t SPI_UseFrame16(uint16_t size)
+{
+	return (SPI_DFF16_MIN != 0 && size >= SPI_DFF16_MIN && (size % 2) == 0);
+}
+
+// Waits for the last frame to leave, then clears RXNE and the overrun flag
+static void SPI_DrainReceive(SPI_TypeDef *regs)
+{
+	while(!(regs->SR & SPI_SR_TXE));
+	while(regs->SR & SPI_SR_BSY);
+	(void)regs->DR;
+	(void)regs->SR;
+}
+
+/**
+ * @brief	Write-only kernel: DR is reloaded as soon as TXE sets, so the
+ * 			next frame is always queued behind the one being shifted out.
+ * 			Received data is never read and is dropped once at the end.
+ */
+static void SPI_WriteKernel(SPI_TypeDef *regs, const uint8_t *txData, uint16_t size)
+{
+	uint16_t i;
+
+	if(SPI_UseFrame16(size))
+	{
+		SPI_SetFrame16(regs, 1);
+		for(i = 0; i < size; i += 2)
+		{
+			while(!(regs->SR & SPI_SR_TXE));
+			regs->DR = (txData[i] << 8) | txData[i + 1];
+		}
+		SPI_DrainReceive(regs);
+		SPI_SetFrame16(regs, 0);
+		return;
+	}
+
+	for(i = 0; i < size; i++)
+	{
+		while(!(regs->SR & SPI_SR_TXE));
+		regs->DR = txData[i];
+	}
+	SPI_DrainReceive(regs);
+}
+
+// One pipelined run of a read, the last frame is collected before it returns
+static void SPI_ReadRun(SPI_TypeDef *regs, uint8_t *rxData, uint16_t size, uint8_t frame16)
+{
+	uint16_t i;
+	uint16_t frame;
+
+	if(frame16)
+	{
+		regs->DR = 0xFFFF;
+		for(i = 0; i < size; i += 2)
+		{
+			if((i + 2) < size)
+			{
+				while(!(regs->SR & SPI_SR_TXE));
+				regs->DR = 0xFFFF;
+			}
+			while(!(regs->SR & SPI_SR_RXNE));
+			frame = regs->DR;
+			if(rxData != NULL)
+			{
+				rxData[i] = frame >> 8;
+				rxData[i + 1] = frame & 0xFF;
+			}
+		}
+		return;
+	}
+
+	regs->DR = 0xFF;
+	for(i = 0; i < size; i++)
+	{
+		if((i + 1) < size)
+		{
+			while(!(regs->SR & SPI_SR_TXE));
+			regs->DR = 0xFF;
+		}
+		while(!(regs->SR & SPI_SR_RXNE));
+		frame = regs->DR;
+		if(rxData != NULL)
+		{
+			rxData[i] = frame;
+		}
+	}
+}
+
+/**
+ * @brief	Read-only kernel: the dummy frame for byte i+1 is queued before
+ * 			byte i is collected, so SCK never idles between frames. With two
+ * 			frames in flight any interrupt longer than one frame time would
+ * 			overrun the receiver, so interrupts are masked, but only for
+ * 			SPI_READ_MASKED_BYTES at a time: the pipeline drains and the
+ * 			caller's PRIMASK is restored between runs, bounding the latency
+ * 			SysTick and the UART see. An overrun that still happens is
+ * 			cleared and counted.
+ * @param	rxData	Receive buffer, or NULL to only clock the bus
+ */
+static void SPI_ReadKernel(SPI_TypeDef *regs, uint8_t *rxData, uint16_t size)
+{
+	uint8_t frame16 = SPI_UseFrame16(size);
+	uint32_t primask;
+	uint16_t offset;
+	uint16_t run;
+
+	if(size == 0)
+	{
+		return;
+	}
+
+	if(frame16)
+	{
+		SPI_SetFrame16(regs, 1);
+	}
+	for(offset = 0; offset < size; offset += run)
+	{
+		run = size - offset;
+		if(run > SPI_READ_MASKED_BYTES)
+		{
+			run = SPI_READ_MASKED_BYTES;
+		}
+		primask = SPI2_IRQ_SAVE();
+		SPI2_IRQ_DISABLE();
+		SPI_ReadRun(regs, (rxData != NULL) ? &rxData[offset] : NULL, run, frame16);
+		SPI2_IRQ_RESTORE(primask);
+	}
+	if(frame16)
+	{
+		SPI_SetFrame16(regs, 0);
+	}
+
+	// Reading DR then SR clears OVR, otherwise every later frame is lost
+	if(regs->SR & SPI_SR_OVR)
+	{
+		(void)regs->DR;
+		(void)regs->SR;
+		rxOverruns++;
+	}
+}
+
+// Lockstep exchange, one frame in flight at a time
+static void SPI_ExchangeKernel(SPI_TypeDef *regs, const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	for(uint16_t i = 0; i < size; i++)
+	{
+		while(!(regs->SR & SPI_SR_TXE));
+		regs->DR = txData[i];
+		while(!(regs->SR & SPI_SR_RXNE));
+		rxData[i] = regs->DR;
+	}
+}
+
+// Picks the polled kernel matching the direction of the transfer
+static void SPI_PolledTransfer(SPI_TypeDef *regs, const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	if(txData == NULL)
+	{
+		SPI_ReadKernel(regs, rxData, size);
+	}
+	else if(rxData == NULL)
+	{
+		SPI_WriteKernel(regs, txData, size);
+	}
+	else
+	{
+		SPI_ExchangeKernel(regs, txData, rxData, size);
+	}
+}
+
+static void SPI2_DMA_Init(void)
+{
+	// Enable clock for DMA1
+	SPI2_RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+
+	SPI2_DMA_RX_STREAM->CR &= ~DMA_SxCR_EN;
+	SPI2_DMA_TX_STREAM->CR &= ~DMA_SxCR_EN;
+	SPI2_DMA_RX_STREAM->PAR = SPI2_DMA_ADDRESS(&SPI2_REGS->DR);
+	SPI2_DMA_TX_STREAM->PAR = SPI2_DMA_ADDRESS(&SPI2_REGS->DR);
+
+	// Completion is signalled by the RX stream, which always finishes last
+	SPI2_DMA_IRQ_ENABLE();
+}
+
 void SPI2_Init(void)
 {
 	// Enable clock for GPIO Port B
-	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
+	SPI2_RCC->AHB1ENR |= RCC_AHB1ENR_GPIOBEN;
 	// Enable clock SPI2 peripheral
-	RCC->APB1ENR |= RCC_APB1ENR_SPI2EN;
+	SPI2_RCC->APB1ENR |= RCC_APB1ENR_SPI2EN;
 
 	// Configure PB13, PB14, PB15 as Alternate Function for SPI2
-	GPIOB->MODER &= ~(GPIO_MODER_MODE12 | GPIO_MODER_MODE13 | GPIO_MODER_MODE14 | GPIO_MODER_MODE15);
-	GPIOB->MODER |= (GPIO_MODER_MODE12_0 | GPIO_MODER_MODE13_1 | GPIO_MODER_MODE14_1 | GPIO_MODER_MODE15_1);
-	GPIOB->AFR[1] |= ((5 << 20) | (5 << 24) | (5 << 28));
+	SPI2_GPIO->MODER &= ~(GPIO_MODER_MODE12 | GPIO_MODER_MODE13 | GPIO_MODER_MODE14 | GPIO_MODER_MODE15);
+	SPI2_GPIO->MODER |= (GPIO_MODER_MODE12_0 | GPIO_MODER_MODE13_1 | GPIO_MODER_MODE14_1 | GPIO_MODER_MODE15_1);
+	SPI2_GPIO->AFR[1] |= ((5 << 20) | (5 << 24) | (5 << 28));
 
 	// Pull CS High
 	SPI2_DeselectSlave();
 
-	// Configure SPI2 in master mode, baud rate = fPCLK / 16, CPOL = 0, CPHA = 0, 8-bit data format
-	SPI2->CR1 = SPI_CR1_MSTR | SPI_CR1_BR_1 | SPI_CR1_SSI | SPI_CR1_SSM;
+	// Configure SPI2 in master mode, SCK up to SPI2_MAX_SCK_HZ, CPOL = 0, CPHA = 0, 8-bit data format
+	SPI2_REGS->CR1 = SPI_CR1_MSTR | SPI2_BaudRateBits(CLOCK_Get()->pclk1Hz, SPI2_MAX_SCK_HZ) | SPI_CR1_SSI | SPI_CR1_SSM;
 	// Enable SPI2
-	SPI2->CR1 |= SPI_CR1_SPE;
+	SPI2_REGS->CR1 |= SPI_CR1_SPE;
+
+	SPI2_DMA_Init();
 }
 
 void SPI2_SelectSlave(void)
 {
 	// Pull CS low
-	GPIOB->BSRR = (1 << 28);
+	SPI2_GPIO->BSRR = (1 << 28);
 }
 
 void SPI2_DeselectSlave(void)
 {
     	// Pull CS high
-    	GPIOB->BSRR = (1 << 12);
+    	SPI2_GPIO->BSRR = (1 << 12);
 }
 
 uint8_t SPI2_TransmitReceiveByte(uint8_t data)
 {
     	// Wait until TXE (Transmit buffer empty)
-    	while(!(SPI2->SR & SPI_SR_TXE));
+    	while(!(SPI2_REGS->SR & SPI_SR_TXE));
     	// Send data
-    	SPI2->DR = data;
+    	SPI2_REGS->DR = data;
     	// Wait until RXNE (Receive buffer not empty)
-    	while(!(SPI2->SR & SPI_SR_RXNE));
+    	while(!(SPI2_REGS->SR & SPI_SR_RXNE));
     	// Return received data
-    	return (uint8_t)(SPI2->DR);
+    	return (uint8_t)(SPI2_REGS->DR);
 }
 
 void SPI2_TransmitReceive_MultiByte(uint8_t *txData, uint8_t *rxData, uint16_t size)
@@ -58,13 +306,13 @@ void SPI2_TransmitReceive_MultiByte(uint8_t *txData, uint8_t *rxData, uint16_t s
     	while (i < size)
     	{
         	// Wait until TXE (Transmit buffer empty)
-        	while (!(SPI2->SR & SPI_SR_TXE));
-        	// Transmit data
-        	SPI2->DR = txData[i];
+        	while (!(SPI2_REGS->SR & SPI_SR_TXE));
+        	// Transmit data, or a dummy byte if there is nothing to send
+        	SPI2_REGS->DR = (txData != NULL) ? txData[i] : 0xFF;
         	// Wait until RXNE (Receive buffer not empty)
-       		while (!(SPI2->SR & SPI_SR_RXNE));
+       		while (!(SPI2_REGS->SR & SPI_SR_RXNE));
         	// Read received data, even if rxData is NULL (to clear RXNE flag)
-        	uint8_t receivedByte = (uint8_t)(SPI2->DR);
+        	uint8_t receivedByte = (uint8_t)(SPI2_REGS->DR);
         	// Store received data only if rxData is not NULL
         	if (rxData != NULL)
         	{
@@ -73,3 +321,282 @@ void SPI2_TransmitReceive_MultiByte(uint8_t *txData, uint8_t *rxData, uint16_t s
         	i++;
     	}
 }
+
+/**
+ * @brief	Starts a DMA transfer on SPI2 and returns immediately
+ * @param	txData		Bytes to send, or NULL to clock out 0xFF (RX-only)
+ * @param	rxData		Buffer filled in place, or NULL to discard (TX-only)
+ * @param	size		Number of bytes to transfer
+ * @param	callback	Called from the DMA interrupt on completion, may be NULL
+ * @return	0 if the transfer was started, 1 if a transfer is already running
+ */
+uint8_t SPI2_DMA_Start(const uint8_t *txData, uint8_t *rxData, uint16_t size, SPI2_DMA_Callback callback)
+{
+	uint32_t streamConfig = DMA_SxCR_PL_1;
+
+	if(dmaBusy)
+	{
+		return 1;
+	}
+	if(size == 0)
+	{
+		if(callback != NULL)
+		{
+			callback();
+		}
+		return 0;
+	}
+
+	dmaBusy = 1;
+	dmaCallback = callback;
+
+	// Drop any byte left over from a polled transfer
+	if(SPI2_REGS->SR & SPI_SR_RXNE)
+	{
+		(void)SPI2_REGS->DR;
+	}
+
+	SPI2_DMA->LIFCR = DMA_RX_FLAGS;
+	SPI2_DMA->HIFCR = DMA_TX_FLAGS;
+
+	// RX stream: peripheral to memory, straight into the caller's buffer
+	SPI2_DMA_RX_STREAM->NDTR = size;
+	SPI2_DMA_RX_STREAM->M0AR = SPI2_DMA_ADDRESS((rxData != NULL) ? rxData : &dmaDummyRx);
+	SPI2_DMA_RX_STREAM->CR = streamConfig | DMA_SxCR_TCIE | ((rxData != NULL) ? DMA_SxCR_MINC : 0);
+
+	// TX stream: memory to peripheral
+	SPI2_DMA_TX_STREAM->NDTR = size;
+	SPI2_DMA_TX_STREAM->M0AR = SPI2_DMA_ADDRESS((txData != NULL) ? txData : &dmaDummyTx);
+	SPI2_DMA_TX_STREAM->CR = streamConfig | DMA_SxCR_DIR_0 | ((txData != NULL) ? DMA_SxCR_MINC : 0);
+
+	SPI2_DMA_RX_STREAM->CR |= DMA_SxCR_EN;
+	SPI2_DMA_TX_STREAM->CR |= DMA_SxCR_EN;
+
+	// Enable RX requests before TX so no received byte is missed
+	SPI2_REGS->CR2 |= SPI_CR2_RXDMAEN;
+	SPI2_REGS->CR2 |= SPI_CR2_TXDMAEN;
+
+	return 0;
+}
+
+uint8_t SPI2_DMA_IsBusy(void)
+{
+	return dmaBusy;
+}
+
+/**
+ * @brief	Runs a DMA transfer on SPI2 and waits for it to complete
+ * @param	txData		Bytes to send, or NULL for RX-only
+ * @param	rxData		Receive buffer, or NULL for TX-only
+ * @param	size		Number of bytes to transfer
+ */
+void SPI2_DMA_TransmitReceive(const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	while(SPI2_DMA_Start(txData, rxData, size, NULL));
+	SPI2_DMA_Wait();
+}
+
+void SPI2_DMA_Wait(void)
+{
+	while(dmaBusy)
+	{
+		SPI2_DMA_POLL();
+	}
+}
+
+/**
+ * @brief	Bulk transfer that uses DMA when it is worth the setup cost
+ * @param	txData		Bytes to send, or NULL for RX-only
+ * @param	rxData		Receive buffer, or NULL for TX-only
+ * @param	size		Number of bytes to transfer
+ */
+void SPI2_Transfer(const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	if(size < SPI2_DMA_THRESHOLD)
+	{
+		SPI_PolledTransfer(SPI2_REGS, txData, rxData, size);
+	}
+	else
+	{
+		SPI2_DMA_TransmitReceive(txData, rxData, size);
+	}
+}
+
+/**
+ * @brief	Polled write-only transfer on SPI2, RX data is discarded
+ */
+void SPI2_Write(const uint8_t *txData, uint16_t size)
+{
+	SPI_WriteKernel(SPI2_REGS, txData, size);
+}
+
+/**
+ * @brief	Polled read-only transfer on SPI2, 0xFF is clocked out
+ */
+void SPI2_Read(uint8_t *rxData, uint16_t size)
+{
+	SPI_ReadKernel(SPI2_REGS, rxData, size);
+}
+
+/**
+ * @brief	Returns how many polled reads lost a frame to a receive overrun
+ */
+uint32_t SPI2_RxOverruns(void)
+{
+	return rxOverruns;
+}
+
+uint32_t SPI_BytesPerKiloCycle(uint16_t size, uint32_t cycles)
+{
+	return (cycles == 0) ? 0 : (uint32_t)(((uint64_t)size * 1000) / cycles);
+}
+
+/**
+ * @brief	Times every SPI2 transfer path on the same buffer with the DWT
+ * 			cycle counter. Run it with every chip select high, so the
+ * 			traffic is ignored by the slaves.
+ * @param	buffer	Data sent, and overwritten by the read and exchange runs
+ * @param	size	Number of bytes per run
+ * @param	result	Filled with the cycles taken by each path
+ */
+void SPI2_Benchmark(uint8_t *buffer, uint16_t size, SPI2_BenchResult *result)
+{
+	uint32_t start;
+
+	cycle_counter_init();
+	result->size = size;
+
+	start = cycle_count();
+	SPI2_TransmitReceive_MultiByte(buffer, buffer, size);
+	result->exchangeCycles = cycle_count() - start;
+
+	start = cycle_count();
+	SPI_WriteKernel(SPI2_REGS, buffer, size);
+	result->writeCycles = cycle_count() - start;
+
+	start = cycle_count();
+	SPI_ReadKernel(SPI2_REGS, buffer, size);
+	result->readCycles = cycle_count() - start;
+
+	start = cycle_count();
+	SPI2_DMA_TransmitReceive(buffer, buffer, size);
+	result->dmaCycles = cycle_count() - start;
+}
+
+void DMA1_Stream3_IRQHandler(void)
+{
+	SPI2_DMA_Callback callback = dmaCallback;
+
+	SPI2_DMA->LIFCR = DMA_RX_FLAGS;
+	SPI2_DMA->HIFCR = DMA_TX_FLAGS;
+
+	SPI2_REGS->CR2 &= ~(SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN);
+	SPI2_DMA_RX_STREAM->CR &= ~DMA_SxCR_EN;
+	SPI2_DMA_TX_STREAM->CR &= ~DMA_SxCR_EN;
+
+	dmaCallback = NULL;
+	dmaBusy = 0;
+
+	if(callback != NULL)
+	{
+		callback();
+	}
+}
+
+/**
+ * @brief	Configures a GPIO pin as a push-pull chip select, idle high
+ * @param	port	GPIO port of the CS pin
+ * @param	pin		Pin number within the port
+ */
+void SPI_InitChipSelect(GPIO_TypeDef *port, uint8_t pin)
+{
+	GPIO_TypeDef *gpio = SPI_GpioRegisters(port);
+
+	// GPIO ports are 0x400 apart starting at GPIOA, matching the AHB1ENR bit order
+	SPI2_RCC->AHB1ENR |= (1UL << (((uintptr_t)port - GPIOA_BASE) / 0x400));
+	SPI_DeselectSlave(port, pin);
+	gpio->MODER &= ~(3UL << (pin * 2));
+	gpio->MODER |= (1UL << (pin * 2));
+}
+
+void SPI_SelectSlave(GPIO_TypeDef *port, uint8_t pin)
+{
+	SPI_GpioRegisters(port)->BSRR = (1UL << (pin + 16));
+}
+
+void SPI_DeselectSlave(GPIO_TypeDef *port, uint8_t pin)
+{
+	SPI_GpioRegisters(port)->BSRR = (1UL << pin);
+}
+
+uint8_t SPI_TransmitReceiveByte(SPI_TypeDef *spi, uint8_t data)
+{
+	SPI_TypeDef *regs = SPI_Registers(spi);
+
+	while(!(regs->SR & SPI_SR_TXE));
+	regs->DR = data;
+	while(!(regs->SR & SPI_SR_RXNE));
+	return (uint8_t)(regs->DR);
+}
+
+/**
+ * @brief	Bulk transfer on any SPI instance. SPI2 goes through the DMA
+ * 			engine, other instances are polled and must be set up by the caller.
+ * @param	spi		SPI instance
+ * @param	txData	Bytes to send, or NULL for RX-only
+ * @param	rxData	Receive buffer, or NULL for TX-only
+ * @param	size	Number of bytes to transfer
+ */
+void SPI_Transfer(SPI_TypeDef *spi, const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	if(spi == SPI2)
+	{
+		SPI2_Transfer(txData, rxData, size);
+		return;
+	}
+	SPI_PolledTransfer(spi, txData, rxData, size);
+}
+
+/**
+ * @brief	Changes the SCK prescaler of an SPI instance between transfers
+ * @param	spi			SPI instance
+ * @param	baudRate	BR[2:0], SCK = fPCLK / 2^(baudRate+1)
+ * @return	Setting applied, SPI2 is never run above SPI2_MAX_SCK_HZ
+ */
+uint8_t SPI_SetBaudRate(SPI_TypeDef *spi, uint8_t baudRate)
+{
+	SPI_TypeDef *regs = SPI_Registers(spi);
+	uint8_t fastest = SPI_BAUD_FASTEST;
+
+	if(spi == SPI2)
+	{
+		SPI2_DMA_Wait();
+		fastest = SPI2_BaudRateBits(CLOCK_Get()->pclk1Hz, SPI2_MAX_SCK_HZ) >> SPI_CR1_BR_Pos;
+	}
+	if(baudRate < fastest)
+	{
+		baudRate = fastest;
+	}
+	if(baudRate > SPI_BAUD_SLOWEST)
+	{
+		baudRate = SPI_BAUD_SLOWEST;
+	}
+
+	// Devices sharing a bus are reselected often, most of the time at the same speed
+	if(((regs->CR1 & SPI_CR1_BR) >> SPI_CR1_BR_Pos) == baudRate)
+	{
+		return baudRate;
+	}
+
+	// BR may only change while the peripheral is idle and disabled
+	while(regs->SR & SPI_SR_BSY);
+	regs->CR1 &= ~SPI_CR1_SPE;
+	regs->CR1 = (regs->CR1 & ~SPI_CR1_BR) | ((uint32_t)baudRate << SPI_CR1_BR_Pos);
+	regs->CR1 |= SPI_CR1_SPE;
+	return baudRate;
+}
+
+uint8_t SPI_GetBaudRate(SPI_TypeDef *spi)
+{
+	return (SPI_Registers(spi)->CR1 & SPI_CR1_BR) >> SPI_CR1_BR_Pos;
+}
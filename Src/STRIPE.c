@@ -0,0 +1,214 @@
+#include "STRIPE.h"
+
+/* Logical block L lives on device (L % deviceCount) as physical block
+ * (L / deviceCount). Consecutive blocks therefore sit on different chips,
+ * and a program or erase on one chip overlaps with work on the others. */
+
+static uint8_t STRIPE_DeviceOf(STRIPE_Volume *volume, uint32_t block)
+{
+	return block % volume->deviceCount;
+}
+
+static uint32_t STRIPE_PhysicalAddress(STRIPE_Volume *volume, uint32_t address)
+{
+	uint32_t block = address / volume->blockSize;
+	return ((block / volume->deviceCount) * volume->blockSize) + (address % volume->blockSize);
+}
+
+static void STRIPE_Select(W25Q_Device *device)
+{
+	// Selecting reprograms the bus speed, so skip it when nothing changes
+	if(device != NULL && W25Q_GetDevice() != device)
+	{
+		W25Q_SelectDevice(device);
+	}
+}
+
+/**
+ * @brief	Keeps every chip moving until the given one is free, then
+ * 			collects the result of its last operation. The given chip is
+ * 			left selected, so the caller can submit its next operation.
+ */
+static W25Q_Status STRIPE_WaitDevice(STRIPE_Volume *volume, uint8_t index)
+{
+	do
+	{
+		for(uint8_t i = 0; i < volume->deviceCount; i++)
+		{
+			if(i != index)
+			{
+				STRIPE_Select(volume->devices[i]);
+				W25Q_Poll();
+			}
+		}
+		STRIPE_Select(volume->devices[index]);
+	} while(W25Q_Poll() == W25Q_ASYNC_BUSY);
+	return W25Q_Complete();
+}
+
+static W25Q_Status STRIPE_WaitAll(STRIPE_Volume *volume, W25Q_Status status)
+{
+	W25Q_Status deviceStatus;
+
+	for(uint8_t i = 0; i < volume->deviceCount; i++)
+	{
+		deviceStatus = STRIPE_WaitDevice(volume, i);
+		if(status == W25Q_OK)
+		{
+			status = deviceStatus;
+		}
+	}
+	return status;
+}
+
+/**
+ * @brief	Builds a striped volume over already initialised devices, which
+ * 			must share the same block size
+ * @param	volume		Volume to initialise
+ * @param	devices		Array of deviceCount devices
+ * @param	deviceCount	Number of chips, 1 to STRIPE_MAX_DEVICES
+ */
+W25Q_Status STRIPE_Init(STRIPE_Volume *volume, W25Q_Device **devices, uint8_t deviceCount)
+{
+	uint32_t blocksPerDevice;
+
+	if(deviceCount == 0 || deviceCount > STRIPE_MAX_DEVICES)
+	{
+		return W25Q_ERROR_PARAM;
+	}
+
+	volume->deviceCount = deviceCount;
+	volume->blockSize = devices[0]->blockSize;
+	blocksPerDevice = devices[0]->byteCount / devices[0]->blockSize;
+
+	for(uint8_t i = 0; i < deviceCount; i++)
+	{
+		if(devices[i]->blockSize != volume->blockSize)
+		{
+			return W25Q_ERROR_PARAM;
+		}
+		// The smallest chip bounds every stripe
+		if((devices[i]->byteCount / devices[i]->blockSize) < blocksPerDevice)
+		{
+			blocksPerDevice = devices[i]->byteCount / devices[i]->blockSize;
+		}
+		volume->devices[i] = devices[i];
+	}
+	volume->blockCount = blocksPerDevice * deviceCount;
+	return W25Q_OK;
+}
+
+uint32_t STRIPE_ByteCount(STRIPE_Volume *volume)
+{
+	return volume->blockCount * volume->blockSize;
+}
+
+W25Q_Status STRIPE_Read(STRIPE_Volume *volume, uint32_t address, uint8_t *buffer, uint32_t length)
+{
+	W25Q_Device *active = W25Q_GetDevice();
+	W25Q_Status status = W25Q_OK;
+	W25Q_Stream stream;
+	uint32_t bytesToRead;
+
+	if(address > STRIPE_ByteCount(volume) || length > (STRIPE_ByteCount(volume) - address))
+	{
+		return W25Q_ERROR_PARAM;
+	}
+
+	while(status == W25Q_OK && length > 0)
+	{
+		bytesToRead = volume->blockSize - (address % volume->blockSize);
+		if(length < bytesToRead)
+		{
+			bytesToRead = length;
+		}
+
+		STRIPE_Select(volume->devices[STRIPE_DeviceOf(volume, address / volume->blockSize)]);
+		status = W25Q_StreamOpen(&stream, STRIPE_PhysicalAddress(volume, address), bytesToRead);
+		if(status == W25Q_OK)
+		{
+			W25Q_StreamRead(&stream, buffer, bytesToRead);
+			W25Q_StreamClose(&stream);
+		}
+
+		address += bytesToRead;
+		buffer += bytesToRead;
+		length -= bytesToRead;
+	}
+	STRIPE_Select(active);
+	return status;
+}
+
+/**
+ * @brief	Programs a range of the volume. Each block-sized piece is handed
+ * 			to its chip asynchronously, so chips program in parallel. The
+ * 			data must stay valid until the call returns.
+ */
+W25Q_Status STRIPE_Write(STRIPE_Volume *volume, uint32_t address, uint8_t *data, uint32_t length)
+{
+	W25Q_Device *active = W25Q_GetDevice();
+	W25Q_Status status = W25Q_OK;
+	uint32_t bytesToWrite;
+	uint32_t physicalAddress;
+	uint8_t index;
+
+	if(address > STRIPE_ByteCount(volume) || length > (STRIPE_ByteCount(volume) - address))
+	{
+		return W25Q_ERROR_PARAM;
+	}
+
+	while(status == W25Q_OK && length > 0)
+	{
+		bytesToWrite = volume->blockSize - (address % volume->blockSize);
+		if(length < bytesToWrite)
+		{
+			bytesToWrite = length;
+		}
+
+		index = STRIPE_DeviceOf(volume, address / volume->blockSize);
+		status = STRIPE_WaitDevice(volume, index);
+		if(status == W25Q_OK)
+		{
+			physicalAddress = STRIPE_PhysicalAddress(volume, address);
+			status = W25Q_WriteDataAsync(physicalAddress / volume->devices[index]->pageSize,
+										 physicalAddress % volume->devices[index]->pageSize,
+										 bytesToWrite, data);
+		}
+
+		address += bytesToWrite;
+		data += bytesToWrite;
+		length -= bytesToWrite;
+	}
+	status = STRIPE_WaitAll(volume, status);
+	STRIPE_Select(active);
+	return status;
+}
+
+/**
+ * @brief	Erases whole logical blocks, overlapping the erases of
+ * 			different chips
+ */
+W25Q_Status STRIPE_EraseBlocks(STRIPE_Volume *volume, uint32_t firstBlock, uint32_t blockCount)
+{
+	W25Q_Device *active = W25Q_GetDevice();
+	W25Q_Status status = W25Q_OK;
+	uint8_t index;
+
+	if(firstBlock > volume->blockCount || blockCount > (volume->blockCount - firstBlock))
+	{
+		return W25Q_ERROR_PARAM;
+	}
+
+	for(uint32_t block = firstBlock; status == W25Q_OK && block < firstBlock + blockCount; block++)
+	{
+		index = STRIPE_DeviceOf(volume, block);
+		status = STRIPE_WaitDevice(volume, index);
+		if(status == W25Q_OK)
+		{
+			status = W25Q_Erase64kBlockAsync(block / volume->deviceCount);
+		}
+	}
+	status = STRIPE_WaitAll(volume, status);
+	STRIPE_Select(active);
+	return status;
+}
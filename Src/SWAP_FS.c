@@ -1,4 +1,36 @@
 #include "SWAP_FS.h"
+#include "PROFILE.h"
+#include "TELEMETRY.h"
+#include "TRACE.h"
+
+// The block map shares security register 3 with the calibration pattern
+#if TOTAL_BLOCKS > W25Q_CAL_OFFSET
+#error "Block map would overlap the calibration pattern in security register 3"
+#endif
+
+static uint32_t swapThreshold = SFS_SWAP_THRESHOLD;
+
+#if SFS_LOG_LEVEL >= SFS_LOG_CONSOLE
+
+/* Console layout drawn by SFS_DisplayConsole() from the top of the screen:
+ * a title line, then a grid line above and below every row of cells. */
+#define CONSOLE_GRID_LINES		(2 + (ROWS * 2))
+#define CONSOLE_ERASE_TOP		1
+#define CONSOLE_MAP_TOP			(CONSOLE_ERASE_TOP + CONSOLE_GRID_LINES)
+#define CONSOLE_BOTTOM			(CONSOLE_MAP_TOP + CONSOLE_GRID_LINES)
+
+// Values currently on screen, so updates only redraw the cells that changed
+static uint32_t shownEraseCount[TOTAL_BLOCKS];
+static uint8_t shownBlockMap[TOTAL_BLOCKS];
+static uint8_t consoleShown;
+static uint32_t consoleIntervalMs = SFS_CONSOLE_INTERVAL_MS;
+static uint32_t nextConsoleUpdate;
+
+// Deferred mode: writes only mark the console dirty, SFS_Report() draws it
+static uint8_t deferredReport;
+static uint8_t consoleDirty;
+
+#endif
 
 /**
  * @brief Read Erase Count array from Security Register to retrieve
@@ -9,6 +41,7 @@
  */
 static void SFS_ReadEraseCount(uint32_t *eraseCountArr)
 {
+	PROFILE_FUNCTION();
 	uint8_t tempBuffer[256];
 
 	W25Q_ReadSecurityRegister(1, 0, tempBuffer, 256);
@@ -38,6 +71,7 @@ static void SFS_ReadEraseCount(uint32_t *eraseCountArr)
  */
 static void SFS_ReadBlockMap(uint8_t *blockMapArr)
 {
+	PROFILE_FUNCTION();
 	uint8_t tempBuffer[128];
 	W25Q_ReadSecurityRegister(3, 0, tempBuffer, 128);
 	for (int i = 0; i < 128; i++)
@@ -52,7 +86,7 @@ static void SFS_ReadBlockMap(uint8_t *blockMapArr)
  * @param 	blockNumber 	Memory Block Number
  * @return 	Erase count of the particular Block
  */
-static uint32_t SFS_CheckEraseCount(uint32_t *eraseCountArr, uint8_t blockNumber)
+static uint32_t SFS_CheckEraseCount(const uint32_t *eraseCountArr, uint8_t blockNumber)
 {
 	return eraseCountArr[blockNumber];
 }
@@ -63,12 +97,13 @@ static uint32_t SFS_CheckEraseCount(uint32_t *eraseCountArr, uint8_t blockNumber
  * @param	blockNumber 	Memory Block Number
  * @return 	Index of block with Lowest Erase Count
  */
-static uint8_t SFS_FindLowestEraseCount(uint32_t *eraseCountArr, uint8_t blockNumber)
+static uint8_t SFS_FindLowestEraseCount(const uint32_t *eraseCountArr, uint8_t blockNumber)
 {
-	int lowestCount = eraseCountArr[blockNumber];
-	int lowestIndex = blockNumber;
+	PROFILE_FUNCTION();
+	uint32_t lowestCount = eraseCountArr[blockNumber];
+	uint8_t lowestIndex = blockNumber;
 
-	for(int i = 0; i < 128; i++)
+	for(int i = 0; i < TOTAL_BLOCKS; i++)
 	{
 		if(eraseCountArr[i] < lowestCount)
 		{
@@ -109,6 +144,7 @@ static void SFS_LinkBlockMap(uint8_t *blockMap, uint8_t blockNumber, uint8_t low
  */
 static void SFS_UpdateEraseCountInMemory(uint8_t blockNumber, uint32_t eraseCount)
 {
+	PROFILE_FUNCTION();
 	uint8_t countArr[4];
 
 	uint8_t regNumber = (blockNumber < 64) ? 1 : 2;
@@ -130,11 +166,14 @@ static void SFS_UpdateEraseCountInMemory(uint8_t blockNumber, uint32_t eraseCoun
  */
 static void SFS_UpdateBlockMapinMemory(uint8_t blockNumber, uint8_t position)
 {
+	PROFILE_FUNCTION();
 	uint8_t	regOffset = (blockNumber % 64) * 2;
 
 	W25Q_WriteSecurityRegister(3, regOffset, &position, 1);
 }
 
+#if SFS_LOG_LEVEL >= SFS_LOG_CONSOLE
+
 /**
  * @brief Print horizontal line to separate values in console
  */
@@ -155,6 +194,7 @@ static void SFS_PrintHorizontalLine(void)
  */
 static void SFS_DisplayConsole(uint32_t *eraseCountArr, uint8_t *blockMap)
 {
+	PROFILE_FUNCTION();
 	// Set color to Yellow
     printf("\033[33m");
     printf("Erase Count Array:\n");
@@ -193,19 +233,206 @@ static void SFS_DisplayConsole(uint32_t *eraseCountArr, uint8_t *blockMap)
 }
 
 /**
- * @brief	Moves up cursor to Top of screen and Updates values
+ * @brief	Moves the cursor onto the value of a grid cell
+ * @param	gridTop		First screen line of the grid
+ * @param	index		Cell index, row major
+ */
+static void SFS_MoveToCell(int gridTop, int index)
+{
+	// Each row of cells sits below a grid line, each cell is "| " plus 6 digits and a space
+	printf("\033[%d;%dH", gridTop + 2 + ((index / COLUMNS) * 2), 3 + ((index % COLUMNS) * 9));
+}
+
+/**
+ * @brief	Redraws only the cells whose value changed since the last update,
+ * 			at most once per console interval
  * @param	eraseCountArr	Pointer to Erase Count array
  * @param 	blockMap 		Pointer to Block Map array
+ * @return	0 if the update was held back by the rate limit, 1 otherwise
  */
-static void SFS_UpdateConsole(uint32_t *eraseCountArr, uint8_t *blockMap)
+static uint8_t SFS_UpdateConsole(uint32_t *eraseCountArr, uint8_t *blockMap)
 {
-    // Move cursor up enough lines to overwrite both arrays (ROWS * 2 + headers + gridlines)
-    for (int i = 0; i < (ROWS + 1) * 2 + 4; i++)
-    {
-        printf("\033[A");  // Move cursor up one line
-    }
-    // Re-display the arrays with updated values
-    SFS_DisplayConsole(eraseCountArr, blockMap);
+	PROFILE_FUNCTION();
+	uint8_t changed = 0;
+	uint8_t mapChanged = 0;
+
+	// Binary telemetry owns the link while it is enabled
+	if(TLM_IsEnabled())
+	{
+		return 1;
+	}
+	if(!consoleShown)
+	{
+		SFS_RepaintConsole(eraseCountArr, blockMap);
+		return 1;
+	}
+	// Skipped changes are still different from the shown values next time
+	if(!deadline_expired(nextConsoleUpdate))
+	{
+		return 0;
+	}
+	nextConsoleUpdate = get_ticks() + consoleIntervalMs;
+
+	for(int i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		if(eraseCountArr[i] != shownEraseCount[i])
+		{
+			if(!changed)
+			{
+				printf("\033[33m");
+				changed = 1;
+			}
+			SFS_MoveToCell(CONSOLE_ERASE_TOP, i);
+			printf("%6lu", eraseCountArr[i]);
+			shownEraseCount[i] = eraseCountArr[i];
+		}
+	}
+	for(int i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		if(blockMap[i] != shownBlockMap[i])
+		{
+			if(!mapChanged)
+			{
+				printf("\033[37m");
+				mapChanged = 1;
+			}
+			SFS_MoveToCell(CONSOLE_MAP_TOP, i);
+			printf("%6d", blockMap[i]);
+			shownBlockMap[i] = blockMap[i];
+		}
+	}
+
+	// Restore the colour and park the cursor below the grids
+	if(changed || mapChanged)
+	{
+		printf("\033[0m\033[%d;1H", CONSOLE_BOTTOM);
+	}
+	return 1;
+}
+
+/**
+ * @brief	Called wherever the tables change: draws the change now, or in
+ * 			deferred mode only records that the console is out of date
+ */
+static void SFS_ConsoleChanged(uint32_t *eraseCountArr, uint8_t *blockMap)
+{
+	if(deferredReport)
+	{
+		consoleDirty = 1;
+		return;
+	}
+	SFS_UpdateConsole(eraseCountArr, blockMap);
+}
+
+/**
+ * @brief	Clears the terminal and draws both grids in full. Use it after
+ * 			other output has scrolled or overwritten the console.
+ * @param	eraseCountArr	Pointer to Erase Count array
+ * @param 	blockMap 		Pointer to Block Map array
+ */
+void SFS_RepaintConsole(uint32_t *eraseCountArr, uint8_t *blockMap)
+{
+	PROFILE_FUNCTION();
+	printf("\033[2J\033[H");
+	SFS_DisplayConsole(eraseCountArr, blockMap);
+	for(int i = 0; i < TOTAL_BLOCKS; i++)
+	{
+		shownEraseCount[i] = eraseCountArr[i];
+		shownBlockMap[i] = blockMap[i];
+	}
+	consoleShown = 1;
+	nextConsoleUpdate = get_ticks() + consoleIntervalMs;
+}
+
+/**
+ * @brief	Sets the minimum time between two console updates
+ * @param	intervalMs	Milliseconds, 0 redraws on every write
+ */
+void SFS_SetConsoleInterval(uint32_t intervalMs)
+{
+	consoleIntervalMs = intervalMs;
+}
+
+/**
+ * @brief	Moves console drawing off the write path. Writes only mark the
+ * 			console dirty and SFS_Report() draws it from the idle loop.
+ * @param	enable	1 for deferred reporting, 0 to draw on every write
+ */
+void SFS_SetDeferredReport(uint8_t enable)
+{
+	deferredReport = enable;
+}
+
+/**
+ * @brief	Brings the console up to date if a write left it dirty. Call it
+ * 			from the idle loop in deferred mode.
+ * @param	eraseCountArr	Pointer to Erase Count array
+ * @param 	blockMap 		Pointer to Block Map array
+ */
+void SFS_Report(uint32_t *eraseCountArr, uint8_t *blockMap)
+{
+	PROFILE_FUNCTION();
+	if(consoleDirty && SFS_UpdateConsole(eraseCountArr, blockMap))
+	{
+		consoleDirty = 0;
+	}
+}
+
+#else
+
+// Console compiled out, the write path keeps no display state
+#define SFS_ConsoleChanged(eraseCountArr, blockMap)	((void)0)
+
+void SFS_RepaintConsole(uint32_t *eraseCountArr, uint8_t *blockMap)
+{
+	(void)eraseCountArr;
+	(void)blockMap;
+}
+
+void SFS_SetConsoleInterval(uint32_t intervalMs)
+{
+	(void)intervalMs;
+}
+
+void SFS_SetDeferredReport(uint8_t enable)
+{
+	(void)enable;
+}
+
+void SFS_Report(uint32_t *eraseCountArr, uint8_t *blockMap)
+{
+	(void)eraseCountArr;
+	(void)blockMap;
+}
+
+#endif
+
+/**
+ * @brief	Erases the three metadata registers. Register 3 also holds the
+ * 			driver's calibration pattern, which is read first and programmed
+ * 			back so calibration does not have to recreate it.
+ */
+static void SFS_EraseMetadata(void)
+{
+	uint8_t pattern[W25Q_CAL_LENGTH];
+	uint8_t blank = 1;
+
+	W25Q_ReadSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, pattern, W25Q_CAL_LENGTH);
+	for(uint32_t i = 0; i < W25Q_CAL_LENGTH; i++)
+	{
+		if(pattern[i] != 0xFF)
+		{
+			blank = 0;
+			break;
+		}
+	}
+	W25Q_EraseSecurityRegister(1);
+	W25Q_EraseSecurityRegister(2);
+	W25Q_EraseSecurityRegister(3);
+	if(!blank)
+	{
+		W25Q_WriteSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, pattern, W25Q_CAL_LENGTH);
+	}
 }
 
 /**
@@ -214,18 +441,17 @@ static void SFS_UpdateConsole(uint32_t *eraseCountArr, uint8_t *blockMap)
  */
 void SFS_InitFS(void)
 {
+	PROFILE_FUNCTION();
 	static int exec = 0;
 	if(!exec)
 	{
-		W25Q_EraseSecurityRegister(1);
-		W25Q_EraseSecurityRegister(2);
-		W25Q_EraseSecurityRegister(3);
-		printf("File-system Initialized for first time\n\r");
+		SFS_EraseMetadata();
+		SFS_LOG("File-system Initialized for first time\n\r");
 		exec = 1;
 	}
 	else
 	{
-		printf("File-system already Initialized\n\r");
+		SFS_LOG("File-system already Initialized\n\r");
 	}
 }
 
@@ -238,9 +464,54 @@ void SFS_InitFS(void)
  */
 void SFS_ReadFS(uint32_t *eraseCountArr, uint8_t *blockMapArr)
 {
+	PROFILE_FUNCTION();
 	SFS_ReadEraseCount(eraseCountArr);
 	SFS_ReadBlockMap(blockMapArr);
-	SFS_UpdateConsole(eraseCountArr, blockMapArr);
+	TLM_Mount(TOTAL_BLOCKS, W25Q_BlockSize);
+	TLM_Snapshot(eraseCountArr, blockMapArr, TOTAL_BLOCKS);
+	SFS_ConsoleChanged(eraseCountArr, blockMapArr);
+}
+
+/**
+ * @brief	Chooses the physical block a write to a logical block goes to.
+ * 			Only reads the erase counts, so models can run it without flash.
+ * @param	eraseCountArr	Pointer to Erase Count Array
+ * @param	blockNumber		Logical Memory Block Number
+ * @return	Physical block to erase and program
+ */
+uint8_t SFS_SelectBlock(const uint32_t *eraseCountArr, uint8_t blockNumber)
+{
+	PROFILE_FUNCTION();
+	uint32_t currentEraseCount;
+	uint8_t lowestCountBlock;
+
+	if(swapThreshold == 0)
+	{
+		return blockNumber;
+	}
+	currentEraseCount = SFS_CheckEraseCount(eraseCountArr, blockNumber);
+	lowestCountBlock = SFS_FindLowestEraseCount(eraseCountArr, blockNumber);
+
+	// Stay on the block until the least worn one is swapThreshold erases younger
+	if(currentEraseCount - eraseCountArr[lowestCountBlock] < swapThreshold)
+	{
+		return blockNumber;
+	}
+	return lowestCountBlock;
+}
+
+/**
+ * @brief	Updates the working copy tables after a write went to a block,
+ * 			without touching the flash
+ * @param	eraseCountArr	Pointer to Erase Count Array
+ * @param	blockMap		Pointer to Block Map Array
+ * @param	blockNumber		Logical Memory Block Number
+ * @param	physicalBlock	Block chosen by SFS_SelectBlock()
+ */
+void SFS_RecordWrite(uint32_t *eraseCountArr, uint8_t *blockMap, uint8_t blockNumber, uint8_t physicalBlock)
+{
+	SFS_IncrementEraseCount(eraseCountArr, blockNumber);
+	SFS_LinkBlockMap(blockMap, blockNumber, physicalBlock);
 }
 
 /**
@@ -253,23 +524,56 @@ void SFS_ReadFS(uint32_t *eraseCountArr, uint8_t *blockMapArr)
  */
 void SFS_WriteData(uint32_t *eraseCountArr, uint8_t *blockMap, uint8_t blockNumber, uint8_t *data, uint32_t len)
 {
-	uint32_t currentEraseCount = SFS_CheckEraseCount(eraseCountArr, blockNumber);
-	uint8_t lowestCountBlock = SFS_FindLowestEraseCount(eraseCountArr, blockNumber);
-
-	if(eraseCountArr[lowestCountBlock] < currentEraseCount)
-	{
-		lowestCountBlock = blockNumber;
-	}
-
-	uint32_t page = lowestCountBlock * 65536;
+	PROFILE_FUNCTION();
+	uint8_t lowestCountBlock = SFS_SelectBlock(eraseCountArr, blockNumber);
+	uint32_t page = lowestCountBlock * (W25Q_BlockSize / W25Q_PageSize);
+	uint32_t eraseLength = ((len + W25Q_SectorSize - 1) / W25Q_SectorSize) * W25Q_SectorSize;
 
+	// Logged before the flash work so a replay sees when the write was asked for
+	TRACE_Record(TRACE_OP_WRITE, blockNumber, lowestCountBlock, lowestCountBlock * W25Q_BlockSize, len);
+	// Flash can only be programmed once erased
+	W25Q_EraseRange(lowestCountBlock * W25Q_BlockSize, eraseLength);
 	W25Q_WriteData(page, 0, len, data);
 
-	SFS_IncrementEraseCount(eraseCountArr, blockNumber);
-	SFS_LinkBlockMap(blockMap, blockNumber, lowestCountBlock);
+	SFS_RecordWrite(eraseCountArr, blockMap, blockNumber, lowestCountBlock);
 
 	SFS_UpdateEraseCountInMemory(blockNumber, eraseCountArr[lowestCountBlock]+1);
 	SFS_UpdateBlockMapinMemory(blockNumber, lowestCountBlock);
 
-	SFS_UpdateConsole(eraseCountArr, blockMap);
+	TLM_Write(blockNumber, lowestCountBlock, len);
+	TLM_Remap(blockNumber, lowestCountBlock);
+	TLM_EraseCount(blockNumber, eraseCountArr[blockNumber]);
+
+	SFS_ConsoleChanged(eraseCountArr, blockMap);
+}
+
+/**
+ * @brief	Erases the file-system metadata and reloads the working copy,
+ * 			whether or not SFS_InitFS() already ran
+ * @param	eraseCountArr	Pointer to Erase Count array
+ * @param 	blockMapArr 	Pointer to Block Map array
+ */
+void SFS_Format(uint32_t *eraseCountArr, uint8_t *blockMapArr)
+{
+	PROFILE_FUNCTION();
+	SFS_EraseMetadata();
+	SFS_ReadFS(eraseCountArr, blockMapArr);
+}
+
+/**
+ * @brief	Sets how much more worn a block must be than the least worn one
+ * 			before SFS_WriteData() moves its data there
+ * 			Not safe on a device yet: the chosen block is a logical index
+ * 			that may still hold another block's data, and its wear is not
+ * 			tracked per physical block. Only the host models set it.
+ * @param	threshold	Erase-count gap, 0 keeps every block in place
+ */
+void SFS_SetSwapThreshold(uint32_t threshold)
+{
+	swapThreshold = threshold;
+}
+
+uint32_t SFS_GetSwapThreshold(void)
+{
+	return swapThreshold;
 }
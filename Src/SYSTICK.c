@@ -1,13 +1,125 @@
 #include "SYSTICK.h"
 
-void delay_ms(uint32_t ms)
+static volatile uint32_t ticks;
+static volatile tick_hook_t tickHook;
+static uint8_t tickRunning;
+
+// One millisecond of HCLK, SysTick runs from the processor clock
+static uint32_t SysTick_Reload(void)
+{
+	return (CLOCK_Get()->hclkHz / 1000) - 1;
+}
+
+/**
+ * @brief	Starts the free-running 1 ms tick interrupt. Called on first use
+ * 			of the timebase, call again after changing the clock tree.
+ */
+void tick_init(void)
+{
+	SysTick->CTRL = 0;
+	SysTick->LOAD = SysTick_Reload();
+	SysTick->VAL = 0;
+	// Lowest priority, a late tick stays pending and is not lost
+	NVIC_SetPriority(SysTick_IRQn, (1UL << __NVIC_PRIO_BITS) - 1);
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+	tickRunning = 1;
+}
+
+void SysTick_Handler(void)
+{
+	tick_hook_t hook = tickHook;
+
+	ticks++;
+	if(hook != NULL)
+	{
+		hook();
+	}
+}
+
+/**
+ * @brief	Milliseconds since the tick was started, wraps after 49 days
+ */
+uint32_t get_ticks(void)
 {
-	uint32_t i;
-	SysTick->CTRL |= (1<<0) | (1<<2) ;
-	SysTick->LOAD  = 15999;
-	for(i=0; i<ms; i++)
+	if(!tickRunning)
 	{
-		while(!(SysTick->CTRL & (1<<16)));
+		tick_init();
 	}
-	SysTick->CTRL &=~(1U<<0) ;
+	return ticks;
+}
+
+/**
+ * @brief	Microseconds since the tick was started, for latency measurements
+ */
+uint32_t get_micros(void)
+{
+	uint32_t ms;
+	uint32_t count;
+
+	// Re-read if the tick interrupt fired between the two reads
+	do
+	{
+		ms = get_ticks();
+		count = SysTick->VAL;
+	} while(ms != ticks);
+
+	return (ms * 1000) + ((SysTick->LOAD - count) / (CLOCK_Get()->hclkHz / 1000000));
+}
+
+/**
+ * @brief	Deadline the given number of milliseconds from now. The current
+ * 			tick may be partly over, so one extra tick is added.
+ */
+uint32_t deadline_after(uint32_t ms)
+{
+	return get_ticks() + ms + 1;
+}
+
+uint8_t deadline_expired(uint32_t deadline)
+{
+	// Signed difference keeps working across the counter wrap
+	return ((int32_t)(get_ticks() - deadline) >= 0);
+}
+
+/**
+ * @brief	Sleeps the core between tick interrupts until the deadline passes
+ */
+void sleep_until(uint32_t deadline)
+{
+	while(!deadline_expired(deadline))
+	{
+		__WFI();
+	}
+}
+
+/**
+ * @brief	Runs background work once per millisecond from the tick interrupt
+ * @param	hook	Function to call, NULL to remove it
+ */
+void tick_set_hook(tick_hook_t hook)
+{
+	tickHook = hook;
+}
+
+void delay_ms(uint32_t ms)
+{
+	sleep_until(deadline_after(ms));
+}
+
+void cycle_counter_init(void)
+{
+	// Enable the DWT cycle counter for sub-millisecond timestamps
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t cycle_count(void)
+{
+	return DWT->CYCCNT;
+}
+
+uint32_t cycles_to_us(uint32_t cycles)
+{
+	return cycles / (CLOCK_Get()->hclkHz / 1000000);
 }
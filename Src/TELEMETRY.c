@@ -0,0 +1,145 @@
+#include <stddef.h>
+#include "TELEMETRY.h"
+#include "COBS.h"
+#include "CRC.h"
+#include "SYSTICK.h"
+
+static TLM_Output tlmOutput;
+static uint8_t tlmSequence;
+
+// Record being built, and room for its encoding between two delimiters
+static uint8_t record[TLM_MAX_RECORD];
+static uint8_t frame[COBS_MAX_ENCODED(TLM_MAX_RECORD) + 2];
+static uint32_t recordLength;
+
+static void TLM_PutU8(uint8_t value)
+{
+	record[recordLength++] = value;
+}
+
+static void TLM_PutU16(uint16_t value)
+{
+	TLM_PutU8(value & 0xFF);
+	TLM_PutU8(value >> 8);
+}
+
+static void TLM_PutU32(uint32_t value)
+{
+	TLM_PutU16(value & 0xFFFF);
+	TLM_PutU16(value >> 16);
+}
+
+static void TLM_Begin(TLM_Event event)
+{
+	recordLength = 0;
+	TLM_PutU8(event);
+	TLM_PutU8(tlmSequence++);
+	TLM_PutU32(get_ticks());
+}
+
+static void TLM_End(void)
+{
+	uint32_t frameLength;
+
+	TLM_PutU16(CRC16_Update(CRC16_INIT, record, recordLength));
+	// Leading delimiter too, so text printed in between cannot corrupt the frame
+	frame[0] = 0x00;
+	frameLength = COBS_Encode(record, recordLength, &frame[1]) + 1;
+	frame[frameLength++] = 0x00;
+	tlmOutput((const char *)frame, frameLength);
+}
+
+/**
+ * @brief	Starts emitting telemetry records
+ * @param	output	Receives each encoded frame, NULL turns telemetry off
+ */
+void TLM_Init(TLM_Output output)
+{
+	tlmOutput = output;
+	tlmSequence = 0;
+}
+
+uint8_t TLM_IsEnabled(void)
+{
+	return (tlmOutput != NULL);
+}
+
+void TLM_Mount(uint16_t blockCount, uint32_t blockSize)
+{
+	if(tlmOutput == NULL)
+	{
+		return;
+	}
+	TLM_Begin(TLM_EVENT_MOUNT);
+	TLM_PutU16(blockCount);
+	TLM_PutU32(blockSize);
+	TLM_End();
+}
+
+void TLM_Write(uint8_t logicalBlock, uint8_t physicalBlock, uint32_t length)
+{
+	if(tlmOutput == NULL)
+	{
+		return;
+	}
+	TLM_Begin(TLM_EVENT_WRITE);
+	TLM_PutU8(logicalBlock);
+	TLM_PutU8(physicalBlock);
+	TLM_PutU32(length);
+	TLM_End();
+}
+
+void TLM_Remap(uint8_t logicalBlock, uint8_t physicalBlock)
+{
+	if(tlmOutput == NULL)
+	{
+		return;
+	}
+	TLM_Begin(TLM_EVENT_REMAP);
+	TLM_PutU8(logicalBlock);
+	TLM_PutU8(physicalBlock);
+	TLM_End();
+}
+
+void TLM_EraseCount(uint8_t block, uint32_t eraseCount)
+{
+	if(tlmOutput == NULL)
+	{
+		return;
+	}
+	TLM_Begin(TLM_EVENT_ERASE_COUNT);
+	TLM_PutU8(block);
+	TLM_PutU32(eraseCount);
+	TLM_End();
+}
+
+/**
+ * @brief	Sends the full erase count and block map tables, split into
+ * 			records of TLM_SNAPSHOT_BLOCKS blocks
+ */
+void TLM_Snapshot(const uint32_t *eraseCountArr, const uint8_t *blockMap, uint16_t blockCount)
+{
+	uint16_t count;
+
+	if(tlmOutput == NULL)
+	{
+		return;
+	}
+	for(uint16_t first = 0; first < blockCount; first += count)
+	{
+		count = blockCount - first;
+		if(count > TLM_SNAPSHOT_BLOCKS)
+		{
+			count = TLM_SNAPSHOT_BLOCKS;
+		}
+		TLM_Begin(TLM_EVENT_SNAPSHOT);
+		TLM_PutU8(first);
+		TLM_PutU8(count);
+		for(uint16_t i = first; i < first + count; i++)
+		{
+			TLM_PutU32(eraseCountArr[i]);
+			TLM_PutU8(blockMap[i]);
+		}
+		TLM_End();
+	}
+}
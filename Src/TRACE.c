@@ -0,0 +1,202 @@
+#include "TRACE.h"
+
+#if TRACE_ENABLE
+
+#include <stddef.h>
+#include "stm32f4xx.h"
+#include "COBS.h"
+#include "CRC.h"
+#include "SYSTICK.h"
+
+static TRACE_Output traceOutput;
+static TRACE_Mode traceMode;
+static uint8_t traceSequence;
+
+static uint8_t ring[TRACE_RING_RECORDS][TRACE_RECORD_SIZE];
+static volatile uint32_t ringHead;
+static volatile uint32_t ringCount;
+static uint32_t ringOverwritten;
+
+// Record and CRC, and room for their encoding between two delimiters
+static uint8_t frame[COBS_MAX_ENCODED(TRACE_RECORD_SIZE + TRACE_CRC_SIZE) + 2];
+
+static void TRACE_PutU32(uint8_t *p, uint32_t value)
+{
+	p[0] = value & 0xFF;
+	p[1] = (value >> 8) & 0xFF;
+	p[2] = (value >> 16) & 0xFF;
+	p[3] = value >> 24;
+}
+
+static void TRACE_Send(const uint8_t *record)
+{
+	uint8_t buffer[TRACE_RECORD_SIZE + TRACE_CRC_SIZE];
+	uint16_t crc = CRC16_Update(CRC16_INIT, record, TRACE_RECORD_SIZE);
+	uint32_t frameLength;
+
+	if(traceOutput == NULL)
+	{
+		return;
+	}
+	for(uint32_t i = 0; i < TRACE_RECORD_SIZE; i++)
+	{
+		buffer[i] = record[i];
+	}
+	buffer[TRACE_RECORD_SIZE] = crc & 0xFF;
+	buffer[TRACE_RECORD_SIZE + 1] = crc >> 8;
+	// Leading delimiter too, so text printed in between cannot corrupt the frame
+	frame[0] = 0x00;
+	frameLength = COBS_Encode(buffer, sizeof(buffer), &frame[1]) + 1;
+	frame[frameLength++] = 0x00;
+	traceOutput((const char *)frame, frameLength);
+}
+
+/**
+ * @brief	Sets where streamed and dumped records go and starts recording
+ * 			into the ring
+ * @param	output	Receives each encoded frame, NULL keeps records in RAM only
+ */
+void TRACE_Init(TRACE_Output output)
+{
+	traceOutput = output;
+	traceSequence = 0;
+	TRACE_Clear();
+	traceMode = TRACE_RING;
+}
+
+void TRACE_SetMode(TRACE_Mode mode)
+{
+	traceMode = mode;
+}
+
+TRACE_Mode TRACE_GetMode(void)
+{
+	return traceMode;
+}
+
+/**
+ * @brief	Records one access, called by the hooks in SWAP_FS and the driver.
+ * 			Only copies into the ring, so it is safe from interrupt context;
+ * 			streamed records are sent later by TRACE_Poll().
+ * @param	op				What happened
+ * @param	logicalBlock	SWAP_FS logical block, TRACE_NO_BLOCK for driver records
+ * @param	physicalBlock	Flash block the access lands in, TRACE_NO_BLOCK if none
+ * @param	address			First byte address
+ * @param	length			Number of bytes
+ */
+void TRACE_Record(TRACE_Op op, uint8_t logicalBlock, uint8_t physicalBlock, uint32_t address, uint32_t length)
+{
+	uint32_t timestamp;
+	uint32_t primask;
+	uint8_t *record;
+
+	if(traceMode == TRACE_OFF)
+	{
+		return;
+	}
+	timestamp = get_micros();
+
+	// A hook in an interrupt may preempt one in the main loop
+	primask = __get_PRIMASK();
+	__disable_irq();
+	record = ring[ringHead];
+	record[0] = op;
+	record[1] = traceSequence++;
+	record[2] = logicalBlock;
+	record[3] = physicalBlock;
+	TRACE_PutU32(&record[4], timestamp);
+	TRACE_PutU32(&record[8], address);
+	TRACE_PutU32(&record[12], length);
+
+	ringHead = (ringHead + 1) % TRACE_RING_RECORDS;
+	if(ringCount < TRACE_RING_RECORDS)
+	{
+		ringCount++;
+	}
+	else
+	{
+		ringOverwritten++;
+	}
+	__set_PRIMASK(primask);
+}
+
+// Takes the oldest record out of the ring, returns 0 if it is empty
+static uint8_t TRACE_Pop(uint8_t *record)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t index;
+	uint8_t popped = 0;
+
+	__disable_irq();
+	if(ringCount > 0)
+	{
+		index = (ringHead + TRACE_RING_RECORDS - ringCount) % TRACE_RING_RECORDS;
+		for(uint32_t i = 0; i < TRACE_RECORD_SIZE; i++)
+		{
+			record[i] = ring[index][i];
+		}
+		ringCount--;
+		popped = 1;
+	}
+	__set_PRIMASK(primask);
+	return popped;
+}
+
+/**
+ * @brief	Sends up to TRACE_POLL_RECORDS queued records in stream mode.
+ * 			Call from the main loop, sending may wait for the UART.
+ */
+void TRACE_Poll(void)
+{
+	uint8_t record[TRACE_RECORD_SIZE];
+
+	if(traceMode != TRACE_STREAM)
+	{
+		return;
+	}
+	for(uint32_t sent = 0; sent < TRACE_POLL_RECORDS && TRACE_Pop(record); sent++)
+	{
+		TRACE_Send(record);
+	}
+}
+
+/**
+ * @brief	Sends the ring contents oldest first and empties it
+ * @return	Number of records sent
+ */
+uint32_t TRACE_Dump(void)
+{
+	uint8_t record[TRACE_RECORD_SIZE];
+	uint32_t count = 0;
+
+	while(TRACE_Pop(record))
+	{
+		TRACE_Send(record);
+		count++;
+	}
+	ringOverwritten = 0;
+	return count;
+}
+
+void TRACE_Clear(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	ringHead = 0;
+	ringCount = 0;
+	ringOverwritten = 0;
+	__set_PRIMASK(primask);
+}
+
+uint32_t TRACE_Count(void)
+{
+	return ringCount;
+}
+
+uint32_t TRACE_Overwritten(void)
+{
+	return ringOverwritten;
+}
+
+#endif
@@ -1,10 +1,32 @@
 #include "UART.h"
+#include "CLOCK.h"
 
 #define UART_BAUDRATE	115200
-#define SYS_FREQ		16000000
-#define APB1_CLK		SYS_FREQ
+#define TX_MASK			(UART2_TX_BUFFER_SIZE - 1)
+#define RX_MASK			(UART2_RX_BUFFER_SIZE - 1)
 
-void UART2_Write(int ch);
+#define DMA_TX_FLAGS	(DMA_HIFCR_CTCIF6 | DMA_HIFCR_CHTIF6 | DMA_HIFCR_CTEIF6 | DMA_HIFCR_CDMEIF6 | DMA_HIFCR_CFEIF6)
+
+/* Single-producer ring: txHead is only written by UART2_Write(), txTail
+ * and txRelease by the interrupt (and by UART2_Write() with interrupts
+ * masked under the overwrite policy).
+ *	txRelease .. txTail	handed to the hardware, must not be reused yet
+ *	txTail .. txHead	queued, not yet handed over
+ */
+static uint8_t txBuffer[UART2_TX_BUFFER_SIZE];
+static volatile uint32_t txHead;
+static volatile uint32_t txTail;
+static volatile uint32_t txRelease;
+static volatile uint8_t txActive;
+static volatile uint32_t txDropped;
+static UART_OverflowPolicy txPolicy = UART_OVERFLOW_BLOCK;
+
+/* Receive ring filled by the RXNE interrupt, emptied by UART2_ReadByte().
+ * Bytes arriving while it is full are counted and discarded. */
+static uint8_t rxBuffer[UART2_RX_BUFFER_SIZE];
+static volatile uint32_t rxHead;
+static volatile uint32_t rxTail;
+static volatile uint32_t rxOverruns;
 
 static uint16_t Compute_UART_Baud(uint32_t periph_clk, uint32_t baudrate)
 {
@@ -16,6 +38,89 @@ static void UART2_SetBaudRate(uint32_t periph_clk, uint32_t baudrate)
 	USART2->BRR = Compute_UART_Baud(periph_clk,baudrate);
 }
 
+static uint32_t UART2_TxFree(void)
+{
+	return (UART2_TX_BUFFER_SIZE - 1) - ((txHead - txRelease) & TX_MASK);
+}
+
+/**
+ * @brief	Hands the next queued bytes to the transmitter. Called with the
+ * 			UART interrupts unable to preempt, or from them.
+ */
+static void UART2_TxKick(void)
+{
+#if UART2_TX_DMA
+	uint32_t length;
+
+	if(txActive || txTail == txHead)
+	{
+		return;
+	}
+	// One contiguous run, the wrap is sent by the next transfer
+	length = (txHead - txTail) & TX_MASK;
+	if(length > UART2_TX_BUFFER_SIZE - txTail)
+	{
+		length = UART2_TX_BUFFER_SIZE - txTail;
+	}
+	if(length > UART2_TX_DMA_CHUNK)
+	{
+		length = UART2_TX_DMA_CHUNK;
+	}
+
+	txActive = 1;
+	DMA1->HIFCR = DMA_TX_FLAGS;
+	DMA1_Stream6->M0AR = (uint32_t)&txBuffer[txTail];
+	DMA1_Stream6->NDTR = length;
+	txTail = (txTail + length) & TX_MASK;
+	DMA1_Stream6->CR |= DMA_SxCR_EN;
+#else
+	if(txTail != txHead)
+	{
+		txActive = 1;
+		USART2->CR1 |= USART_CR1_TXEIE;
+	}
+#endif
+}
+
+// Runs the kick with the transmit interrupt unable to preempt it
+static void UART2_TxKickLocked(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	UART2_TxKick();
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief	Frees room for length bytes by discarding the oldest queued ones
+ */
+static void UART2_TxOverwrite(uint32_t length)
+{
+	uint32_t primask = __get_PRIMASK();
+	uint32_t queued;
+	uint32_t discard;
+
+	__disable_irq();
+	if(UART2_TxFree() < length)
+	{
+		queued = (txHead - txTail) & TX_MASK;
+		discard = length - UART2_TxFree();
+		if(discard > queued)
+		{
+			discard = queued;
+		}
+		txTail = (txTail + discard) & TX_MASK;
+		txDropped += discard;
+		// Bytes in a running DMA chunk are released when it completes
+		if(!txActive || !UART2_TX_DMA)
+		{
+			txRelease = txTail;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
 void UART2_Init(void)
 {
 	/*Enable clock access to GPIOA*/
@@ -27,33 +132,217 @@ void UART2_Init(void)
 	GPIOA->MODER |=(1U<<5);
 	/*Set PA2 alternate function type to UART_TX(AF07)*/
 	GPIOA->AFR[0] |=(0x7<<8);
+	/*Set PA3 mode to alternate function mode */
+	GPIOA->MODER &=~(1U<<6);
+	GPIOA->MODER |=(1U<<7);
+	/*Set PA3 alternate function type to UART_RX(AF07)*/
+	GPIOA->AFR[0] |=(0x7<<12);
 	/*Configure Baud Rate*/
-	UART2_SetBaudRate(APB1_CLK,UART_BAUDRATE);
+	UART2_SetBaudRate(CLOCK_Get()->pclk1Hz,UART_BAUDRATE);
 	/*Configure the Transfer directions*/
 	USART2->CR1 |= (USART_CR1_TE | USART_CR1_RE);
+	/*Interrupt on every received byte*/
+	USART2->CR1 |= USART_CR1_RXNEIE;
 	/*Enable UART module*/
 	USART2->CR1 |= USART_CR1_UE;
+
+#if UART2_TX_DMA
+	/*USART2_TX is DMA1 Stream 6, Channel 4*/
+	RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+	DMA1_Stream6->CR &= ~DMA_SxCR_EN;
+	DMA1_Stream6->PAR = (uint32_t)&USART2->DR;
+	DMA1_Stream6->CR = (4 << DMA_SxCR_CHSEL_Pos) | DMA_SxCR_MINC | DMA_SxCR_DIR_0 | DMA_SxCR_TCIE;
+	USART2->CR3 |= USART_CR3_DMAT;
+	NVIC_EnableIRQ(DMA1_Stream6_IRQn);
+#endif
+	NVIC_EnableIRQ(USART2_IRQn);
 }
 
-void UART2_TxChar(char ch)
+/**
+ * @brief	Queues bytes for transmission and returns without waiting for
+ * 			the line. Must not be called from an interrupt handler.
+ * @param	data	Bytes to send
+ * @param	length	Number of bytes
+ * @return	Number of bytes queued, less than length only under the drop policy
+ */
+uint32_t UART2_Write(const char *data, uint32_t length)
 {
-	/*Wait for Transmit Data Register to be empty*/
-	while(!(USART2->SR & USART_SR_TXE));
-	/*Write to the Transmit Data Register*/
-	USART2->DR = (ch &0xFF);
+	uint32_t written = 0;
+	uint32_t space;
+	uint32_t run;
+
+	while(written < length)
+	{
+		space = UART2_TxFree();
+		if(space == 0)
+		{
+			if(txPolicy == UART_OVERFLOW_DROP)
+			{
+				txDropped += length - written;
+				break;
+			}
+			if(txPolicy == UART_OVERFLOW_OVERWRITE)
+			{
+				UART2_TxOverwrite(length - written);
+			}
+			// Keep the transmitter running while room is made
+			UART2_TxKickLocked();
+			continue;
+		}
+
+		run = length - written;
+		if(run > space)
+		{
+			run = space;
+		}
+		if(run > UART2_TX_BUFFER_SIZE - txHead)
+		{
+			run = UART2_TX_BUFFER_SIZE - txHead;
+		}
+		for(uint32_t i = 0; i < run; i++)
+		{
+			txBuffer[txHead + i] = data[written + i];
+		}
+		// Data must be in the ring before the interrupt can see the new head
+		__DMB();
+		txHead = (txHead + run) & TX_MASK;
+		written += run;
+		UART2_TxKickLocked();
+	}
+	return written;
 }
 
-void UART2_TxString(char *str)
+/**
+ * @brief	Waits until every queued byte has left the shift register
+ */
+void UART2_Flush(void)
 {
-	while(*str)
+	while(txActive || txHead != txTail);
+	while(!(USART2->SR & USART_SR_TC));
+}
+
+void UART2_SetOverflowPolicy(UART_OverflowPolicy policy)
+{
+	txPolicy = policy;
+}
+
+/**
+ * @brief	Bytes discarded by the drop and overwrite policies since reset
+ */
+uint32_t UART2_DroppedBytes(void)
+{
+	return txDropped;
+}
+
+/**
+ * @brief	Takes the oldest received byte without waiting
+ * @param	byte	Receives the byte
+ * @return	1 if a byte was available, 0 if the receive ring is empty
+ */
+uint8_t UART2_ReadByte(uint8_t *byte)
+{
+	if(rxTail == rxHead)
+	{
+		return 0;
+	}
+	*byte = rxBuffer[rxTail];
+	// Slot must be read before the interrupt may reuse it
+	__DMB();
+	rxTail = (rxTail + 1) & RX_MASK;
+	return 1;
+}
+
+/**
+ * @brief	Bytes lost to a full receive ring or a hardware overrun since reset
+ */
+uint32_t UART2_RxOverruns(void)
+{
+	return rxOverruns;
+}
+
+#if UART2_TX_DMA
+void DMA1_Stream6_IRQHandler(void)
+{
+	DMA1->HIFCR = DMA_TX_FLAGS;
+	txRelease = txTail;
+	txActive = 0;
+	UART2_TxKick();
+}
+#endif
+
+void USART2_IRQHandler(void)
+{
+	uint32_t status = USART2->SR;
+	uint8_t byte;
+
+	// Reading DR after SR also clears a pending overrun
+	if(status & (USART_SR_RXNE | USART_SR_ORE))
+	{
+		byte = USART2->DR;
+		if(status & USART_SR_ORE)
+		{
+			rxOverruns++;
+		}
+		if(((rxHead + 1) & RX_MASK) == rxTail)
+		{
+			rxOverruns++;
+		}
+		else
+		{
+			rxBuffer[rxHead] = byte;
+			rxHead = (rxHead + 1) & RX_MASK;
+		}
+	}
+#if !UART2_TX_DMA
+	if((USART2->CR1 & USART_CR1_TXEIE) && (status & USART_SR_TXE))
 	{
-		UART2_TxChar(*str++);
+		if(txTail == txHead)
+		{
+			USART2->CR1 &= ~USART_CR1_TXEIE;
+			txActive = 0;
+		}
+		else
+		{
+			USART2->DR = txBuffer[txTail];
+			txTail = (txTail + 1) & TX_MASK;
+			txRelease = txTail;
+		}
 	}
+#endif
+}
+
+void UART2_TxChar(char ch)
+{
+	UART2_Write(&ch, 1);
+}
+
+void UART2_TxString(char *str)
+{
+	UART2_Write(str, strlen(str));
 }
 
 uint8_t UART2_RxChar(void)
 {
-	while(!(USART2->SR & (1<<5)));
-	return USART2->DR;
+	uint8_t byte;
+
+	while(!UART2_ReadByte(&byte));
+	return byte;
 }
 
+// Routes printf() to USART2 through the ring buffer
+int __io_putchar(int ch)
+{
+	char byte = ch;
+
+	UART2_Write(&byte, 1);
+	return ch;
+}
+
+// Replaces the weak _write() in syscalls.c so printf() queues whole buffers
+int _write(int file, char *ptr, int len)
+{
+	(void)file;
+	// Bytes lost to the drop policy are counted, not reported as an error
+	UART2_Write(ptr, len);
+	return len;
+}
@@ -0,0 +1,81 @@
+#include "W25Qxx.h"
+
+/* STM32 port: the device's SPI instance and GPIO chip select, with DMA
+ * background reads on SPI2 and the SysTick timebase. */
+
+static void W25Q_PortInit(W25Q_Device *device)
+{
+	if(device->spi == SPI2)
+	{
+		SPI2_Init();
+	}
+	SPI_InitChipSelect(device->csPort, device->csPin);
+}
+
+static void W25Q_PortSelect(W25Q_Device *device)
+{
+	SPI_SelectSlave(device->csPort, device->csPin);
+}
+
+static void W25Q_PortDeselect(W25Q_Device *device)
+{
+	SPI_DeselectSlave(device->csPort, device->csPin);
+}
+
+static uint8_t W25Q_PortTransfer(W25Q_Device *device, uint8_t data)
+{
+	return SPI_TransmitReceiveByte(device->spi, data);
+}
+
+static void W25Q_PortBulk(W25Q_Device *device, const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	SPI_Transfer(device->spi, txData, rxData, size);
+}
+
+// Only SPI2 has DMA, other instances and short reads finish before returning
+static void W25Q_PortBulkStart(W25Q_Device *device, uint8_t *rxData, uint16_t size)
+{
+	if(device->spi != SPI2 || size < SPI2_DMA_THRESHOLD)
+	{
+		SPI_Transfer(device->spi, NULL, rxData, size);
+		return;
+	}
+	SPI2_DMA_Start(NULL, rxData, size, NULL);
+}
+
+static void W25Q_PortBulkWait(W25Q_Device *device)
+{
+	if(device->spi == SPI2)
+	{
+		SPI2_DMA_Wait();
+	}
+}
+
+static uint8_t W25Q_PortSetBaudRate(W25Q_Device *device, uint8_t baudRate)
+{
+	if(SPI_GetBaudRate(device->spi) == baudRate)
+	{
+		return baudRate;
+	}
+	return SPI_SetBaudRate(device->spi, baudRate);
+}
+
+static void W25Q_PortWait(void)
+{
+	__WFI();
+}
+
+const W25Q_Port W25Q_DefaultPort =
+{
+	.init = W25Q_PortInit,
+	.select = W25Q_PortSelect,
+	.deselect = W25Q_PortDeselect,
+	.transfer = W25Q_PortTransfer,
+	.bulk = W25Q_PortBulk,
+	.bulkStart = W25Q_PortBulkStart,
+	.bulkWait = W25Q_PortBulkWait,
+	.setBaudRate = W25Q_PortSetBaudRate,
+	.wait = W25Q_PortWait,
+	.millis = get_ticks,
+	.micros = get_micros
+};
@@ -1,301 +1,1489 @@
 #include "W25Qxx.h"
+#include "PROFILE.h"
+#include "TRACE.h"
 
-static void W25Q_WriteEnable(void)
+// Chip on SPI2 with CS on PB12, used until another device is selected
+static W25Q_Device defaultDevice = W25Q_DEVICE_INIT(SPI2, GPIOB, 12);
+static W25Q_Device *w25q = &defaultDevice;
+
+// Units of the SFDP typical time fields, in milliseconds
+static const uint32_t sfdpEraseUnitMs[4] = {1, 16, 128, 1000};
+static const uint32_t sfdpChipEraseUnitMs[4] = {16, 256, 4000, 64000};
+
+static void W25Q_Select(void)
 {
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(ENABLE_WRITE);
-	SPI2_DeselectSlave();
-	delay_ms(10);
+	w25q->port->select(w25q);
 }
 
-static void W25Q_WriteDisable(void)
+static void W25Q_Deselect(void)
 {
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(DISABLE_WRITE);
-	SPI2_DeselectSlave();
-	delay_ms(10);
+	w25q->port->deselect(w25q);
+}
+
+static uint8_t W25Q_TransferByte(uint8_t data)
+{
+	return w25q->port->transfer(w25q, data);
+}
+
+static void W25Q_Transfer(const uint8_t *txData, uint8_t *rxData, uint16_t size)
+{
+	w25q->port->bulk(w25q, txData, rxData, size);
+}
+
+static uint8_t W25Q_SetBaudRate(uint8_t baudRate)
+{
+	return w25q->port->setBaudRate(w25q, baudRate);
+}
+
+// Deadline in port milliseconds, one extra tick covers the one in progress
+static uint32_t W25Q_DeadlineAfter(uint32_t ms)
+{
+	return w25q->port->millis() + ms + 1;
+}
+
+static uint8_t W25Q_DeadlineExpired(uint32_t deadline)
+{
+	return ((int32_t)(w25q->port->millis() - deadline) >= 0);
+}
+
+static W25Q_Status W25Q_WriteEnable(void)
+{
+	W25Q_Select();
+	W25Q_TransferByte(ENABLE_WRITE);
+	W25Q_Deselect();
+
+	// Confirm the Write Enable Latch was set before issuing the command
+	if(!(W25Q_ReadStatusRegister1() & SR1_WEL))
+	{
+		return W25Q_ERROR_WEL;
+	}
+	return W25Q_OK;
 }
 
 static void W25Q_Reset(void)
 {
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(ENABLE_RESET);
-	SPI2_TransmitReceiveByte(EXECUTE_RESET);
-	SPI2_DeselectSlave();
-	delay_ms(100);
+	W25Q_Select();
+	W25Q_TransferByte(ENABLE_RESET);
+	W25Q_TransferByte(EXECUTE_RESET);
+	W25Q_Deselect();
+	// tRST is 30us, one tick covers it
+	uint32_t deadline = W25Q_DeadlineAfter(1);
+	while(!W25Q_DeadlineExpired(deadline))
+	{
+		w25q->port->wait();
+	}
+}
+
+static uint32_t W25Q_GetSecurityRegisterAddress(uint8_t reg)
+{
+	switch(reg)
+	{
+		case 1:		return SECURITY_REG_1;
+		case 2:		return SECURITY_REG_2;
+		case 3:		return SECURITY_REG_3;
+		default : 	return 0;
+	}
 }
 
-void W25Q_Init(void)
+static void W25Q_SendCommandAddress(uint8_t command, uint32_t memAddress)
+{
+	W25Q_TransferByte(command);
+	if(w25q->addressBytes == 4)
+	{
+		W25Q_TransferByte((memAddress >> 24) & 0xFF);
+	}
+	W25Q_TransferByte((memAddress >> 16) & 0xFF);
+	W25Q_TransferByte((memAddress >> 8) & 0xFF);
+	W25Q_TransferByte(memAddress & 0xFF);
+}
+
+/**
+ * @brief	Polls Status Register 1 until the BUSY bit clears
+ * @param	timeoutMs	Maximum time to wait in milliseconds
+ * @return	W25Q_OK when ready, W25Q_ERROR_TIMEOUT otherwise
+ */
+W25Q_Status W25Q_WaitReady(uint32_t timeoutMs)
+{
+	PROFILE_FUNCTION();
+	uint32_t deadline = W25Q_DeadlineAfter(timeoutMs);
+
+	if(w25q->streamOpen)
+	{
+		return W25Q_ERROR_BUSY;
+	}
+	while(W25Q_ReadStatusRegister1() & SR1_BUSY)
+	{
+		if(W25Q_DeadlineExpired(deadline))
+		{
+			return W25Q_ERROR_TIMEOUT;
+		}
+		if(timeoutMs >= W25Q_SLEEP_MIN_MS)
+		{
+			w25q->port->wait();
+		}
+	}
+	return W25Q_OK;
+}
+
+/**
+ * @brief	Whether a new command must be refused. A finished operation holds
+ * 			the job until W25Q_Complete() collects its result, so no
+ * 			submission can overwrite an unread error, and an open stream
+ * 			owns the bus until W25Q_StreamClose().
+ */
+static uint8_t W25Q_Busy(void)
+{
+	return (w25q->job.state != W25Q_ASYNC_IDLE) || w25q->streamOpen;
+}
+
+static void W25Q_WaitJob(void)
+{
+	// Reads are ignored by the chip while it is busy
+	if(w25q->job.suspended)
+	{
+		W25Q_Resume();
+	}
+	while(W25Q_Poll() == W25Q_ASYNC_BUSY)
+	{
+		// Erases take tens of milliseconds or more, sleep until the next tick
+		if(w25q->job.timeoutMs >= W25Q_SLEEP_MIN_MS)
+		{
+			w25q->port->wait();
+		}
+	}
+}
+
+static void W25Q_MarkErased(uint32_t memAddress, uint32_t length, uint8_t erased)
+{
+	uint32_t lastSector = (memAddress + length) / w25q->sectorSize;
+
+	if(lastSector > W25Q_MAX_SECTOR_COUNT)
+	{
+		lastSector = W25Q_MAX_SECTOR_COUNT;
+	}
+	for(uint32_t sector = memAddress / w25q->sectorSize; sector < lastSector; sector++)
+	{
+		if(erased)
+		{
+			w25q->erasedMap[sector / 32] |= (1UL << (sector % 32));
+		}
+		else
+		{
+			w25q->erasedMap[sector / 32] &= ~(1UL << (sector % 32));
+		}
+	}
+}
+
+static uint8_t W25Q_IsKnownErased(uint32_t memAddress, uint32_t length)
+{
+	if((memAddress + length) / w25q->sectorSize > W25Q_MAX_SECTOR_COUNT)
+	{
+		return 0;
+	}
+	for(uint32_t sector = memAddress / w25q->sectorSize; sector < (memAddress + length) / w25q->sectorSize; sector++)
+	{
+		if(!(w25q->erasedMap[sector / 32] & (1UL << (sector % 32))))
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief	Gets the chip ready for a read of the given range. In read-priority
+ * 			mode an erase of a different region is suspended instead of waited on.
+ * @return	1 if the caller must call W25Q_Resume() after the read, 0 otherwise
+ */
+static uint8_t W25Q_PrepareRead(uint32_t memAddress, uint32_t length)
+{
+	uint8_t overlaps = (memAddress < w25q->job.eraseAddress + w25q->job.eraseSize) &&
+					   (w25q->job.eraseAddress < memAddress + length);
+
+	TRACE_Record(TRACE_OP_READ, TRACE_NO_BLOCK, memAddress / w25q->blockSize, memAddress, length);
+	if(w25q->readPriority && w25q->job.state == W25Q_ASYNC_BUSY && w25q->job.suspendable && !overlaps)
+	{
+		if(w25q->job.suspended)
+		{
+			return 0;
+		}
+		if(W25Q_Suspend() == W25Q_OK && w25q->job.suspended)
+		{
+			return 1;
+		}
+	}
+	W25Q_WaitJob();
+	return 0;
+}
+
+/**
+ * @brief	Brings up the bus and chip select of a device, resets the chip
+ * 			and makes it the active device
+ * @param	device	Device described with W25Q_DEVICE_INIT()
+ */
+void W25Q_InitDevice(W25Q_Device *device)
 {
-	SPI2_Init();
+	PROFILE_FUNCTION();
+	device->port->init(device);
+	W25Q_SelectDevice(device);
 	W25Q_Reset();
+	W25Q_Calibrate();
+	// Parts without SFDP keep the geometry they were declared with
+	W25Q_Configure();
+}
+
+/**
+ * @brief	Directs every following W25Q_* call to the given device
+ */
+void W25Q_SelectDevice(W25Q_Device *device)
+{
+	PROFILE_FUNCTION();
+	w25q = device;
+	// Chips sharing a bus may have been calibrated to different speeds
+	if(device->baudRate != W25Q_BAUD_UNSET)
+	{
+		device->port->setBaudRate(device, device->baudRate);
+	}
+}
+
+W25Q_Device *W25Q_GetDevice(void)
+{
+	PROFILE_FUNCTION();
+	return w25q;
+}
+
+static uint32_t W25Q_SfdpDword(const uint8_t *table, uint8_t index)
+{
+	const uint8_t *dword = &table[index * 4];
+	return (dword[0] | (dword[1] << 8) | (dword[2] << 16) | ((uint32_t)dword[3] << 24));
+}
+
+/**
+ * @brief	Reads the Serial Flash Discoverable Parameters area
+ * @param	address		Offset into the SFDP area, always sent as 3 bytes
+ * @param	buffer		Buffer to fill
+ * @param	length		Number of bytes to read
+ */
+W25Q_Status W25Q_ReadSFDP(uint32_t address, uint8_t *buffer, uint16_t length)
+{
+	PROFILE_FUNCTION();
+	if(w25q->streamOpen)
+	{
+		return W25Q_ERROR_BUSY;
+	}
+	W25Q_WaitJob();
+	W25Q_Select();
+	W25Q_TransferByte(READ_SFDP);
+	W25Q_TransferByte((address >> 16) & 0xFF);
+	W25Q_TransferByte((address >> 8) & 0xFF);
+	W25Q_TransferByte(address & 0xFF);
+	// One dummy byte follows the address
+	W25Q_TransferByte(0xFF);
+	W25Q_Transfer(NULL, buffer, length);
+	W25Q_Deselect();
+	return W25Q_OK;
+}
+
+/**
+ * @brief	Records one SFDP erase type as the sector, 32K or 64K erase
+ * @param	sizeExponent	Erase size as a power of two, 0 if unused
+ * @param	command			Erase opcode
+ * @param	timing			Typical time field (5-bit count, 2-bit unit)
+ * @param	maxMultiplier	Maximum time as a multiple of the typical time
+ */
+static void W25Q_ConfigureEraseType(uint8_t sizeExponent, uint8_t command, uint32_t timing, uint32_t maxMultiplier)
+{
+	uint32_t typicalMs = ((timing & 0x1F) + 1) * sfdpEraseUnitMs[(timing >> 5) & 0x03];
+
+	switch(sizeExponent)
+	{
+		case 12:
+			w25q->sectorSize = 4096;
+			w25q->sectorEraseCommand = command;
+			if(maxMultiplier != 0)
+			{
+				w25q->eraseTiming.sectorEraseMs = typicalMs;
+				w25q->eraseTimeout.sectorEraseMs = typicalMs * maxMultiplier;
+			}
+			break;
+		case 15:
+			w25q->block32kEraseCommand = command;
+			if(maxMultiplier != 0)
+			{
+				w25q->eraseTiming.block32kEraseMs = typicalMs;
+				w25q->eraseTimeout.block32kEraseMs = typicalMs * maxMultiplier;
+			}
+			break;
+		case 16:
+			w25q->blockSize = 65536;
+			w25q->block64kEraseCommand = command;
+			if(maxMultiplier != 0)
+			{
+				w25q->eraseTiming.block64kEraseMs = typicalMs;
+				w25q->eraseTimeout.block64kEraseMs = typicalMs * maxMultiplier;
+			}
+			break;
+		default :
+			break;
+	}
+}
+
+/**
+ * @brief	Reads the JEDEC basic flash parameter table of the active device
+ * 			and takes its density, page size, erase opcodes and erase times
+ * 			from it. Parts larger than 16 MB are switched to 4-byte addressing.
+ * @return	W25Q_OK if the table was applied, W25Q_ERROR_PARAM if the part
+ * 			has no usable SFDP and keeps its current configuration
+ */
+W25Q_Status W25Q_Configure(void)
+{
+	PROFILE_FUNCTION();
+	uint8_t header[16];
+	uint8_t table[W25Q_SFDP_MAX_DWORDS * 4];
+	uint32_t tableAddress;
+	uint8_t tableLength;
+	uint32_t density;
+	uint32_t eraseTypes;
+	uint32_t eraseTimes = 0;
+	uint32_t eraseMultiplier = 0;
+	uint32_t programTimes;
+	uint32_t chipEraseTypicalMs;
+
+	w25q->addressBytes = 3;
+	W25Q_ReadSFDP(0, header, sizeof(header));
+	if(W25Q_SfdpDword(header, 0) != W25Q_SFDP_SIGNATURE)
+	{
+		return W25Q_ERROR_PARAM;
+	}
+
+	// The first parameter header always points at the basic flash table
+	tableLength = header[11];
+	tableAddress = header[12] | (header[13] << 8) | (header[14] << 16);
+	if(header[8] != 0x00 || tableLength < 9)
+	{
+		return W25Q_ERROR_PARAM;
+	}
+	if(tableLength > W25Q_SFDP_MAX_DWORDS)
+	{
+		tableLength = W25Q_SFDP_MAX_DWORDS;
+	}
+	W25Q_ReadSFDP(tableAddress, table, tableLength * 4);
+
+	// 2nd DWORD: density in bits, either N-1 or 2^N when bit 31 is set
+	density = W25Q_SfdpDword(table, 1);
+	if(density & 0x80000000)
+	{
+		density &= 0x7FFFFFFF;
+		w25q->byteCount = (density < 35) ? (1UL << (density - 3)) : 0x80000000;
+	}
+	else
+	{
+		w25q->byteCount = (density / 8) + 1;
+	}
+
+	// JESD216A and later append erase times and page size in DWORDs 10 and 11
+	if(tableLength >= 11)
+	{
+		eraseTimes = W25Q_SfdpDword(table, 9);
+		eraseMultiplier = 2 * ((eraseTimes & 0x0F) + 1);
+		programTimes = W25Q_SfdpDword(table, 10);
+		w25q->pageSize = 1UL << ((programTimes >> 4) & 0x0F);
+
+		chipEraseTypicalMs = (((programTimes >> 24) & 0x1F) + 1) * sfdpChipEraseUnitMs[(programTimes >> 29) & 0x03];
+		w25q->chipEraseTimeoutMs = chipEraseTypicalMs * 2 * ((programTimes & 0x0F) + 1);
+	}
+
+	// 8th and 9th DWORDs: four erase types, each a size exponent and opcode
+	for(uint8_t type = 0; type < 4; type++)
+	{
+		eraseTypes = W25Q_SfdpDword(table, 7 + (type / 2)) >> ((type % 2) * 16);
+		W25Q_ConfigureEraseType(eraseTypes & 0xFF, (eraseTypes >> 8) & 0xFF,
+								eraseTimes >> (4 + (type * 7)), eraseMultiplier);
+	}
+
+	if(w25q->byteCount > W25Q_3BYTE_LIMIT)
+	{
+		// 1st DWORD bits 18:17 are 0 for parts that only take 3-byte addresses
+		if(W25Q_SfdpDword(table, 0) & (0x03 << 17))
+		{
+			W25Q_Select();
+			W25Q_TransferByte(ENTER_4BYTE_MODE);
+			W25Q_Deselect();
+		}
+		if(W25Q_ReadStatusRegister3() & SR3_ADS)
+		{
+			w25q->addressBytes = 4;
+		}
+		else
+		{
+			// Stay usable with the part of the array 3-byte addresses can reach
+			w25q->byteCount = W25Q_3BYTE_LIMIT;
+		}
+	}
+	return W25Q_OK;
+}
+
+// Mix of constant and alternating bytes, so every line toggles at full rate
+static uint8_t W25Q_CalibrationByte(uint8_t index)
+{
+	static const uint8_t edges[4] = {0x00, 0xFF, 0x55, 0xAA};
+
+	return (index < 64) ? edges[index & 0x03] : (uint8_t)((index * 167) + 13);
+}
+
+static uint8_t W25Q_CalibrationPasses(uint32_t id, uint16_t crc)
+{
+	uint8_t buffer[W25Q_CAL_LENGTH];
+
+	for(uint8_t i = 0; i < W25Q_CAL_REPEATS; i++)
+	{
+		if(W25Q_ReadID() != id)
+		{
+			return 0;
+		}
+		W25Q_ReadSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, buffer, W25Q_CAL_LENGTH);
+		if(CRC16_Update(CRC16_INIT, buffer, W25Q_CAL_LENGTH) != crc)
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief	Finds the fastest SPI prescaler the wiring to the active device
+ * 			supports. The JEDEC ID and the test pattern are read at the
+ * 			slowest setting as reference, then every setting from fastest
+ * 			to slowest must reproduce them W25Q_CAL_REPEATS times. If a
+ * 			faster setting failed, the chosen one is backed off one step.
+ * @return	W25Q_OK, or W25Q_ERROR_LINK if not even the slowest setting
+ * 			gives consistent reads
+ */
+W25Q_Status W25Q_Calibrate(void)
+{
+	PROFILE_FUNCTION();
+	uint8_t buffer[W25Q_CAL_LENGTH];
+	uint8_t blank = 1;
+	uint8_t failed = 0;
+	uint8_t baudRate;
+	uint32_t id;
+	uint16_t crc;
+	W25Q_Status status;
+
+	w25q->baudRate = W25Q_SetBaudRate(SPI_BAUD_SLOWEST);
+	id = W25Q_ReadID();
+	if(id == 0 || id == 0xFFFFFF)
+	{
+		return W25Q_ERROR_LINK;
+	}
+
+	// Program the pattern once, the register is left alone after that
+	W25Q_ReadSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, buffer, W25Q_CAL_LENGTH);
+	for(uint8_t i = 0; i < W25Q_CAL_LENGTH; i++)
+	{
+		if(buffer[i] != 0xFF)
+		{
+			blank = 0;
+			break;
+		}
+	}
+	if(blank)
+	{
+		for(uint8_t i = 0; i < W25Q_CAL_LENGTH; i++)
+		{
+			buffer[i] = W25Q_CalibrationByte(i);
+		}
+		status = W25Q_WriteSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, buffer, W25Q_CAL_LENGTH);
+		if(status != W25Q_OK)
+		{
+			return status;
+		}
+		W25Q_ReadSecurityRegister(W25Q_CAL_REG, W25Q_CAL_OFFSET, buffer, W25Q_CAL_LENGTH);
+	}
+	crc = CRC16_Update(CRC16_INIT, buffer, W25Q_CAL_LENGTH);
+
+	for(baudRate = SPI_BAUD_FASTEST; baudRate <= SPI_BAUD_SLOWEST; baudRate++)
+	{
+		// Settings above the bus limit come back clamped, skip them
+		if(W25Q_SetBaudRate(baudRate) != baudRate)
+		{
+			continue;
+		}
+		if(W25Q_CalibrationPasses(id, crc))
+		{
+			break;
+		}
+		failed = 1;
+	}
+
+	if(baudRate > SPI_BAUD_SLOWEST)
+	{
+		w25q->baudRate = W25Q_SetBaudRate(SPI_BAUD_SLOWEST);
+		return W25Q_ERROR_LINK;
+	}
+	// A faster setting failed, so this one sits close to the limit
+	if(failed && baudRate < SPI_BAUD_SLOWEST)
+	{
+		baudRate++;
+	}
+	w25q->baudRate = W25Q_SetBaudRate(baudRate);
+	w25q->crcFailures = 0;
+	return W25Q_OK;
+}
+
+/**
+ * @brief	Hook for callers that check CRCs of data read from the chip.
+ * 			W25Q_CAL_FAILURE_LIMIT failures in a row re-run the calibration.
+ * @param	passed	1 if the last CRC check passed, 0 if it failed
+ * @return	W25Q_OK, or the result of the re-calibration
+ */
+W25Q_Status W25Q_ReportCrc(uint8_t passed)
+{
+	PROFILE_FUNCTION();
+	if(passed)
+	{
+		w25q->crcFailures = 0;
+		return W25Q_OK;
+	}
+	if(++w25q->crcFailures < W25Q_CAL_FAILURE_LIMIT)
+	{
+		return W25Q_OK;
+	}
+	return W25Q_Calibrate();
+}
+
+void W25Q_Init(void)
+{
+	PROFILE_FUNCTION();
+	W25Q_InitDevice(&defaultDevice);
 }
 
 void W25Q_PowerDown(void)
 {
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(POWER_DOWN);
-	SPI2_DeselectSlave();
+	PROFILE_FUNCTION();
+	W25Q_Select();
+	W25Q_TransferByte(POWER_DOWN);
+	W25Q_Deselect();
 }
 
 void W25Q_PowerUp(void)
 {
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(POWER_UP);
-	SPI2_DeselectSlave();
+	PROFILE_FUNCTION();
+	W25Q_Select();
+	W25Q_TransferByte(POWER_UP);
+	W25Q_Deselect();
 }
 
 uint32_t W25Q_ReadID(void)
 {
-    	uint8_t dummyByte = 0xFF;
+	PROFILE_FUNCTION();
     	uint8_t id[3];
-    	SPI2_SelectSlave();
-    	SPI2_TransmitReceiveByte(READ_ID);
-    	SPI2_TransmitReceive_MultiByte(&dummyByte, id, 3);
-    	SPI2_DeselectSlave();
+    	if(w25q->streamOpen)
+    	{
+    		return 0;
+    	}
+    	W25Q_WaitJob();
+    	W25Q_Select();
+    	W25Q_TransferByte(READ_ID);
+    	W25Q_Transfer(NULL, id, 3);
+    	W25Q_Deselect();
     	return ((id[0] << 16) | (id[1] << 8) | (id[2]));
 }
 
 uint32_t W25Q_ReadUID(void)
 {
-	uint8_t dummyByte = 0xFF;
+	PROFILE_FUNCTION();
 	uint8_t id[4];
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(READ_UID);
-	SPI2_TransmitReceive_MultiByte(&dummyByte, id, 4);
-	SPI2_DeselectSlave();
+	if(w25q->streamOpen)
+	{
+		return 0;
+	}
+	W25Q_WaitJob();
+	W25Q_Select();
+	W25Q_TransferByte(READ_UID);
+	// Four dummy bytes precede the 64-bit ID, only the upper half is returned
+	W25Q_Transfer(NULL, NULL, 4);
+	W25Q_Transfer(NULL, id, 4);
+	W25Q_Deselect();
 	return ((id[0] << 24) | (id[1] << 16) | (id[2] << 8) | (id[3]));
 }
 
 void W25Q_ReadData(uint32_t startPage, uint8_t offset, uint8_t *buffer, uint16_t length)
 {
-	uint32_t memAddress = (startPage * 256) + offset;
+	PROFILE_FUNCTION();
+	uint32_t memAddress = (startPage * w25q->pageSize) + offset;
+	uint8_t resume;
 
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(NORMAL_READ);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	for (uint16_t i = 0; i < length; i++)
+	if(w25q->streamOpen)
 	{
-		// Send dummy byte and receive data
-		buffer[i] = SPI2_TransmitReceiveByte(0xFF);
+		return;
+	}
+	resume = W25Q_PrepareRead(memAddress, length);
+	W25Q_Select();
+	W25Q_SendCommandAddress(NORMAL_READ, memAddress);
+	// Clock dummy bytes out and receive straight into the caller's buffer
+	W25Q_Transfer(NULL, buffer, length);
+	W25Q_Deselect();
+	if(resume)
+	{
+		W25Q_Resume();
 	}
-	SPI2_DeselectSlave();
 }
 
 void W25Q_FastReadData(uint32_t startPage, uint8_t offset, uint8_t *buffer, uint16_t length)
 {
-	uint32_t memAddress = (startPage * 256) + offset;
+	PROFILE_FUNCTION();
+	uint32_t memAddress = (startPage * w25q->pageSize) + offset;
+	uint8_t resume;
 
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(FAST_READ);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	SPI2_TransmitReceiveByte(0x00);
-	for (uint16_t i = 0; i < length; i++)
+	if(w25q->streamOpen)
+	{
+		return;
+	}
+	resume = W25Q_PrepareRead(memAddress, length);
+	W25Q_Select();
+	W25Q_SendCommandAddress(FAST_READ, memAddress);
+	W25Q_TransferByte(0x00);
+	// Clock dummy bytes out and receive straight into the caller's buffer
+	W25Q_Transfer(NULL, buffer, length);
+	W25Q_Deselect();
+	if(resume)
 	{
-		// Send dummy byte and receive data
-		buffer[i] = SPI2_TransmitReceiveByte(0xFF);
+		W25Q_Resume();
 	}
-	SPI2_DeselectSlave();
 }
 
-static void W25Q_WritePage(uint32_t startPage, uint16_t offset, uint32_t size, uint8_t *data)
+/**
+ * @brief	Opens one FAST_READ transaction at any address. CS stays low and
+ * 			the bus belongs to the stream until W25Q_StreamClose(): reads,
+ * 			program/erase, polling and waits on this device are refused
+ * 			meanwhile, W25Q_ERROR_BUSY where they return a status.
+ * @param	stream		Stream state to initialise
+ * @param	memAddress	First byte to read
+ * @param	length		Total number of bytes the stream may deliver
+ */
+W25Q_Status W25Q_StreamOpen(W25Q_Stream *stream, uint32_t memAddress, uint32_t length)
 {
-	uint32_t memAddress = (startPage * 256) + offset;
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(PAGE_WRITE);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress) & 0xFF);
-	SPI2_TransmitReceive_MultiByte(data, NULL, size);
-	SPI2_DeselectSlave();
-	W25Q_WriteDisable();
-	delay_ms(5);
+	PROFILE_FUNCTION();
+	if(memAddress > w25q->byteCount || length > (w25q->byteCount - memAddress))
+	{
+		return W25Q_ERROR_PARAM;
+	}
+	if(w25q->streamOpen)
+	{
+		return W25Q_ERROR_BUSY;
+	}
+
+	stream->address = memAddress;
+	stream->remaining = length;
+	stream->resume = W25Q_PrepareRead(memAddress, length);
+	stream->open = 1;
+
+	W25Q_Select();
+	W25Q_SendCommandAddress(FAST_READ, memAddress);
+	W25Q_TransferByte(0x00);
+	w25q->streamOpen = 1;
+	return W25Q_OK;
 }
 
-void W25Q_WriteData(uint32_t startPage, uint16_t offset, uint32_t size, uint8_t *data)
+/**
+ * @brief	Reads the next bytes of an open stream, without resending the
+ * 			command or address
+ * @return	Number of bytes read, 0 once the stream is exhausted
+ */
+uint32_t W25Q_StreamRead(W25Q_Stream *stream, uint8_t *buffer, uint32_t length)
 {
-    uint32_t bytesToWrite;
-    uint32_t remainingBytes = size;
-    uint32_t currentPage = startPage;
-    uint16_t currentOffset = offset;
-    uint8_t *currentData = data;
+	PROFILE_FUNCTION();
+	uint32_t total;
+	uint32_t bytesToRead;
 
-    // While there's data left to write
-    while (remainingBytes > 0)
-    {
-        // Calculate how many bytes can be written to the current page
-        bytesToWrite = 256 - currentOffset;
-        if (remainingBytes < bytesToWrite)
-        {
-            bytesToWrite = remainingBytes;
-        }
+	if(!stream->open)
+	{
+		return 0;
+	}
+	if(length > stream->remaining)
+	{
+		length = stream->remaining;
+	}
 
-        // Call W25Q_WritePage() function
-        W25Q_WritePage(currentPage, currentOffset, bytesToWrite, currentData);
+	// A single DMA transfer is limited to 65535 bytes
+	for(total = 0; total < length; total += bytesToRead)
+	{
+		bytesToRead = ((length - total) > 0xFFFF) ? 0xFFFF : (length - total);
+		W25Q_Transfer(NULL, buffer + total, bytesToRead);
+	}
 
-        // Update the remaining data, current data pointer, and Page Number
-        remainingBytes -= bytesToWrite;
-        currentData += bytesToWrite;
-        currentPage++;
-        currentOffset = 0;
-    }
+	stream->address += length;
+	stream->remaining -= length;
+	return length;
 }
 
-void W25Q_EraseSector(uint8_t blockNumber, uint8_t sectorNumber)
+void W25Q_StreamClose(W25Q_Stream *stream)
 {
-	uint32_t memAddress = (blockNumber * 65536) + (sectorNumber * 4096);
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(ERASE_SECTOR);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	SPI2_DeselectSlave();
-	delay_ms(500);
+	PROFILE_FUNCTION();
+	if(!stream->open)
+	{
+		return;
+	}
+	W25Q_Deselect();
+	stream->open = 0;
+	w25q->streamOpen = 0;
+	if(stream->resume)
+	{
+		W25Q_Resume();
+	}
 }
 
-void W25Q_Erase32kBlock(uint8_t blockNumber, uint8_t half)
+/**
+ * @brief	Streams a range of any length through a callback in chunks. The
+ * 			chunk buffer is split in two so DMA fills one half while the
+ * 			callback consumes the other. The callback runs with CS low and
+ * 			the next chunk in flight, so it must not use the flash or SPI2:
+ * 			driver calls made from it are refused, see W25Q_StreamOpen().
+ * @param	memAddress	First byte to read
+ * @param	length		Number of bytes to read
+ * @param	chunk		Scratch buffer of chunkSize bytes
+ * @param	chunkSize	Size of the scratch buffer
+ * @param	callback	Receives each chunk, returns 0 to stop early
+ * @param	context		Passed through to the callback
+ */
+W25Q_Status W25Q_ReadStream(uint32_t memAddress, uint32_t length, uint8_t *chunk, uint32_t chunkSize,
+							W25Q_StreamCallback callback, void *context)
 {
-	uint32_t memAddress = (blockNumber * 65536) + (half * 32768);
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(ERASE_32KBLOCK);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	SPI2_DeselectSlave();
-	delay_ms(1700);
+	W25Q_Stream stream;
+	W25Q_Status status;
+	uint32_t halfSize = chunkSize / 2;
+	uint8_t *filled = chunk;
+	uint8_t *filling = chunk + halfSize;
+	uint8_t *swap;
+	uint32_t filledLength;
+	uint32_t fillingLength;
+
+	if(chunkSize == 0 || callback == NULL)
+	{
+		return W25Q_ERROR_PARAM;
+	}
+	status = W25Q_StreamOpen(&stream, memAddress, length);
+	if(status != W25Q_OK)
+	{
+		return status;
+	}
+
+	if(w25q->port->bulkStart == NULL || halfSize == 0 || halfSize > 0xFFFF)
+	{
+		// The bus cannot overlap, or the buffer cannot be split into two usable halves
+		while((filledLength = W25Q_StreamRead(&stream, chunk, chunkSize)) > 0)
+		{
+			if(!callback(chunk, filledLength, context))
+			{
+				break;
+			}
+		}
+		W25Q_StreamClose(&stream);
+		return W25Q_OK;
+	}
+
+	filledLength = W25Q_StreamRead(&stream, filled, halfSize);
+	while(filledLength > 0)
+	{
+		fillingLength = (stream.remaining < halfSize) ? stream.remaining : halfSize;
+		if(fillingLength > 0)
+		{
+			w25q->port->bulkStart(w25q, filling, fillingLength);
+		}
+		if(!callback(filled, filledLength, context))
+		{
+			w25q->port->bulkWait(w25q);
+			break;
+		}
+		w25q->port->bulkWait(w25q);
+
+		stream.address += fillingLength;
+		stream.remaining -= fillingLength;
+		filledLength = fillingLength;
+		swap = filled;
+		filled = filling;
+		filling = swap;
+	}
+	W25Q_StreamClose(&stream);
+	return W25Q_OK;
 }
 
-void W25Q_Erase64kBlock(uint8_t blockNumber)
+static W25Q_Status W25Q_StartJob(uint32_t timeoutMs)
 {
-	uint32_t memAddress = (blockNumber * 65536);
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(ERASE_64KBLOCK);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	SPI2_DeselectSlave();
-	delay_ms(2100);
+	w25q->job.timeoutMs = timeoutMs;
+	w25q->job.suspended = 0;
+	w25q->job.result = W25Q_OK;
+	w25q->job.state = W25Q_ASYNC_BUSY;
+	w25q->job.deadline = W25Q_DeadlineAfter(timeoutMs);
+	return W25Q_OK;
 }
 
-void W25Q_EraseChip(void)
-{
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(ERASE_CHIP);
-	SPI2_DeselectSlave();
-	delay_ms(100100);
+static W25Q_Status W25Q_StartPage(void)
+{
+	uint32_t memAddress = (w25q->job.page * w25q->pageSize) + w25q->job.offset;
+	uint32_t bytesToWrite = w25q->pageSize - w25q->job.offset;
+	W25Q_Status status;
+
+	if(w25q->job.remaining < bytesToWrite)
+	{
+		bytesToWrite = w25q->job.remaining;
+	}
+
+	status = W25Q_WriteEnable();
+	if(status != W25Q_OK)
+	{
+		return status;
+	}
+	W25Q_MarkErased(memAddress - (memAddress % w25q->sectorSize), w25q->sectorSize, 0);
+	W25Q_Select();
+	W25Q_SendCommandAddress(PAGE_WRITE, memAddress);
+	W25Q_Transfer(w25q->job.data, NULL, bytesToWrite);
+	W25Q_Deselect();
+
+	// Advance to the next page now, Poll() issues it once this one completes
+	w25q->job.eraseSize = 0;
+	w25q->job.remaining -= bytesToWrite;
+	w25q->job.data += bytesToWrite;
+	w25q->job.page++;
+	w25q->job.offset = 0;
+
+	// WEL clears by itself once the program cycle completes
+	return W25Q_StartJob(W25Q_TIMEOUT_PAGE_PROGRAM);
+}
+
+static W25Q_Status W25Q_StartErase(uint8_t command, uint32_t memAddress, uint32_t eraseSize, uint32_t timeoutMs)
+{
+	W25Q_Status status;
+
+	if(W25Q_Busy())
+	{
+		return W25Q_ERROR_BUSY;
+	}
+	w25q->job.remaining = 0;
+	w25q->job.eraseAddress = memAddress;
+	w25q->job.eraseSize = eraseSize;
+	// Chip and security register erases cannot be suspended
+	w25q->job.suspendable = (eraseSize != 0 && command != ERASE_CHIP);
+
+	// Nothing to do if the whole region is already blank
+	if(eraseSize != 0 && W25Q_IsKnownErased(memAddress, eraseSize))
+	{
+		w25q->job.result = W25Q_OK;
+		w25q->job.state = W25Q_ASYNC_DONE;
+		return W25Q_OK;
+	}
+
+	status = W25Q_WriteEnable();
+	if(status != W25Q_OK)
+	{
+		return status;
+	}
+	W25Q_Select();
+	if(command == ERASE_CHIP)
+	{
+		W25Q_TransferByte(command);
+	}
+	else
+	{
+		W25Q_SendCommandAddress(command, memAddress);
+	}
+	W25Q_Deselect();
+	if(eraseSize != 0)
+	{
+		TRACE_Record(TRACE_OP_ERASE, TRACE_NO_BLOCK, memAddress / w25q->blockSize, memAddress, eraseSize);
+	}
+	else
+	{
+		TRACE_Record(TRACE_OP_SECURITY_ERASE, TRACE_NO_BLOCK, TRACE_NO_BLOCK, memAddress, 0);
+	}
+	return W25Q_StartJob(timeoutMs);
+}
+
+/**
+ * @brief	Advances the pending program/erase operation without blocking.
+ * 			Main loop only: it reads the status register without owning the
+ * 			bus, so from an interrupt it would cut into an open transaction.
+ * @return	State of the operation, W25Q_ASYNC_DONE or W25Q_ASYNC_ERROR
+ * 			until collected with W25Q_Complete()
+ */
+W25Q_AsyncState W25Q_Poll(void)
+{
+	PROFILE_FUNCTION();
+	W25Q_Status status;
+
+	// BUSY reads clear while suspended, so there is nothing to learn
+	if(w25q->job.state != W25Q_ASYNC_BUSY || w25q->job.suspended || w25q->streamOpen)
+	{
+		return w25q->job.state;
+	}
+
+	if(W25Q_ReadStatusRegister1() & SR1_BUSY)
+	{
+		if(W25Q_DeadlineExpired(w25q->job.deadline))
+		{
+			w25q->job.result = W25Q_ERROR_TIMEOUT;
+			w25q->job.state = W25Q_ASYNC_ERROR;
+		}
+		return w25q->job.state;
+	}
+
+	// Issue the next page of a multi-page write
+	if(w25q->job.remaining > 0)
+	{
+		status = W25Q_StartPage();
+		if(status != W25Q_OK)
+		{
+			w25q->job.result = status;
+			w25q->job.state = W25Q_ASYNC_ERROR;
+		}
+		return w25q->job.state;
+	}
+
+	W25Q_MarkErased(w25q->job.eraseAddress, w25q->job.eraseSize, 1);
+	w25q->job.state = W25Q_ASYNC_DONE;
+	return w25q->job.state;
+}
+
+/**
+ * @brief	Blocks until the pending operation finishes and collects its result
+ * @return	Result of the operation, W25Q_OK if nothing was pending
+ */
+W25Q_Status W25Q_Complete(void)
+{
+	PROFILE_FUNCTION();
+	W25Q_Status result;
+
+	// Waiting would poll a bus the stream holds, and never finish
+	if(w25q->streamOpen)
+	{
+		return W25Q_ERROR_BUSY;
+	}
+	W25Q_WaitJob();
+	result = w25q->job.result;
+	w25q->job.result = W25Q_OK;
+	w25q->job.state = W25Q_ASYNC_IDLE;
+	return result;
+}
+
+W25Q_Status W25Q_WriteDataAsync(uint32_t startPage, uint16_t offset, uint32_t size, uint8_t *data)
+{
+	PROFILE_FUNCTION();
+	W25Q_Status status;
+
+	if(W25Q_Busy())
+	{
+		return W25Q_ERROR_BUSY;
+	}
+	if(size == 0)
+	{
+		w25q->job.result = W25Q_OK;
+		w25q->job.state = W25Q_ASYNC_DONE;
+		return W25Q_OK;
+	}
+
+	w25q->job.page = startPage;
+	w25q->job.offset = offset;
+	w25q->job.remaining = size;
+	w25q->job.data = data;
+	TRACE_Record(TRACE_OP_PROGRAM, TRACE_NO_BLOCK, (startPage * w25q->pageSize) / w25q->blockSize,
+				 (startPage * w25q->pageSize) + offset, size);
+
+	status = W25Q_StartPage();
+	if(status != W25Q_OK)
+	{
+		w25q->job.state = W25Q_ASYNC_IDLE;
+	}
+	return status;
+}
+
+W25Q_Status W25Q_WritePageAsync(uint32_t page, uint16_t offset, uint32_t size, uint8_t *data)
+{
+	PROFILE_FUNCTION();
+	if((offset + size) > w25q->pageSize)
+	{
+		return W25Q_ERROR_PARAM;
+	}
+	return W25Q_WriteDataAsync(page, offset, size, data);
+}
+
+W25Q_Status W25Q_EraseSectorAsync(uint32_t blockNumber, uint8_t sectorNumber)
+{
+	PROFILE_FUNCTION();
+	uint32_t memAddress = (blockNumber * w25q->blockSize) + (sectorNumber * w25q->sectorSize);
+	return W25Q_StartErase(w25q->sectorEraseCommand, memAddress, w25q->sectorSize, w25q->eraseTimeout.sectorEraseMs);
+}
+
+W25Q_Status W25Q_Erase32kBlockAsync(uint32_t blockNumber, uint8_t half)
+{
+	PROFILE_FUNCTION();
+	uint32_t memAddress = (blockNumber * w25q->blockSize) + (half * (w25q->blockSize / 2));
+	return W25Q_StartErase(w25q->block32kEraseCommand, memAddress, w25q->blockSize / 2, w25q->eraseTimeout.block32kEraseMs);
+}
+
+W25Q_Status W25Q_Erase64kBlockAsync(uint32_t blockNumber)
+{
+	PROFILE_FUNCTION();
+	uint32_t memAddress = (blockNumber * w25q->blockSize);
+	return W25Q_StartErase(w25q->block64kEraseCommand, memAddress, w25q->blockSize, w25q->eraseTimeout.block64kEraseMs);
+}
+
+W25Q_Status W25Q_EraseChipAsync(void)
+{
+	PROFILE_FUNCTION();
+	return W25Q_StartErase(ERASE_CHIP, 0, w25q->byteCount, w25q->chipEraseTimeoutMs);
+}
+
+/**
+ * @brief	Suspends the pending sector/block erase so other reads can be served
+ * @return	W25Q_OK if suspended or already finished, W25Q_ERROR_PARAM if the
+ * 			pending operation cannot be suspended
+ */
+W25Q_Status W25Q_Suspend(void)
+{
+	PROFILE_FUNCTION();
+	if(w25q->job.state != W25Q_ASYNC_BUSY || w25q->job.suspended)
+	{
+		return W25Q_OK;
+	}
+	if(w25q->streamOpen)
+	{
+		return W25Q_ERROR_BUSY;
+	}
+	if(!w25q->job.suspendable)
+	{
+		return W25Q_ERROR_PARAM;
+	}
+
+	// The erase must be allowed to make progress between resume and the next suspend
+	while((w25q->port->micros() - w25q->lastResumeUs) < W25Q_RESUME_TO_SUSPEND_US);
+
+	W25Q_Select();
+	W25Q_TransferByte(SUSPEND);
+	W25Q_Deselect();
+
+	// BUSY drops within tSUS, SUS stays clear if the erase had already finished
+	uint32_t start = w25q->port->micros();
+	while((W25Q_ReadStatusRegister1() & SR1_BUSY) &&
+		  ((w25q->port->micros() - start) <= W25Q_TSUS_US));
+
+	if(W25Q_ReadStatusRegister2() & SR2_SUS)
+	{
+		w25q->job.suspended = 1;
+	}
+	else if(W25Q_ReadStatusRegister1() & SR1_BUSY)
+	{
+		return W25Q_ERROR_TIMEOUT;
+	}
+	return W25Q_OK;
+}
+
+W25Q_Status W25Q_Resume(void)
+{
+	PROFILE_FUNCTION();
+	if(!w25q->job.suspended)
+	{
+		return W25Q_OK;
+	}
+	if(w25q->streamOpen)
+	{
+		return W25Q_ERROR_BUSY;
+	}
+
+	W25Q_Select();
+	W25Q_TransferByte(RESUME);
+	W25Q_Deselect();
+
+	w25q->lastResumeUs = w25q->port->micros();
+	w25q->job.suspended = 0;
+	return W25Q_OK;
+}
+
+uint8_t W25Q_IsSuspended(void)
+{
+	PROFILE_FUNCTION();
+	return w25q->job.suspended;
+}
+
+/**
+ * @brief	Lets reads outside the region being erased suspend the erase
+ * 			instead of waiting for it to finish
+ * @param	enable	1 to enable read-priority mode, 0 to disable
+ */
+void W25Q_SetReadPriority(uint8_t enable)
+{
+	PROFILE_FUNCTION();
+	w25q->readPriority = enable;
+}
+
+static W25Q_Status W25Q_CompleteIfStarted(W25Q_Status status)
+{
+	if(status != W25Q_OK)
+	{
+		return status;
+	}
+	return W25Q_Complete();
+}
+
+W25Q_Status W25Q_WriteData(uint32_t startPage, uint16_t offset, uint32_t size, uint8_t *data)
+{
+	PROFILE_FUNCTION();
+	return W25Q_CompleteIfStarted(W25Q_WriteDataAsync(startPage, offset, size, data));
+}
+
+W25Q_Status W25Q_EraseSector(uint32_t blockNumber, uint8_t sectorNumber)
+{
+	PROFILE_FUNCTION();
+	return W25Q_CompleteIfStarted(W25Q_EraseSectorAsync(blockNumber, sectorNumber));
+}
+
+W25Q_Status W25Q_Erase32kBlock(uint32_t blockNumber, uint8_t half)
+{
+	PROFILE_FUNCTION();
+	return W25Q_CompleteIfStarted(W25Q_Erase32kBlockAsync(blockNumber, half));
+}
+
+W25Q_Status W25Q_Erase64kBlock(uint32_t blockNumber)
+{
+	PROFILE_FUNCTION();
+	return W25Q_CompleteIfStarted(W25Q_Erase64kBlockAsync(blockNumber));
+}
+
+W25Q_Status W25Q_EraseChip(void)
+{
+	PROFILE_FUNCTION();
+	return W25Q_CompleteIfStarted(W25Q_EraseChipAsync());
+}
+
+/**
+ * @brief	Sets the typical erase time of each granularity used by the
+ * 			erase-range planner, so it can be tuned per part
+ * @param	timing	Typical erase times in milliseconds
+ */
+void W25Q_SetEraseTiming(const W25Q_EraseTiming *timing)
+{
+	PROFILE_FUNCTION();
+	w25q->eraseTiming = *timing;
+}
+
+/**
+ * @brief	Picks the cheapest erase command starting at the given address.
+ * 			Every 64K block and 32K half is costed against the sectors that
+ * 			would replace it, which is optimal since erase regions nest.
+ * @param	memAddress	Sector aligned start of the region still to erase
+ * @param	endAddress	End of the region still to erase
+ * @param	step		Filled with the command, address and size to use
+ */
+void W25Q_PlanEraseStep(uint32_t memAddress, uint32_t endAddress, W25Q_EraseStep *step)
+{
+	PROFILE_FUNCTION();
+	uint32_t halfSize = w25q->blockSize / 2;
+	uint32_t sectorsPerHalf = halfSize / w25q->sectorSize;
+	uint32_t halfCost = w25q->eraseTiming.sectorEraseMs * sectorsPerHalf;
+
+	if(w25q->eraseTiming.block32kEraseMs < halfCost)
+	{
+		halfCost = w25q->eraseTiming.block32kEraseMs;
+	}
+
+	step->address = memAddress;
+	if((memAddress % w25q->blockSize) == 0 && (endAddress - memAddress) >= w25q->blockSize &&
+	   w25q->eraseTiming.block64kEraseMs <= (2 * halfCost))
+	{
+		step->command = w25q->block64kEraseCommand;
+		step->size = w25q->blockSize;
+		step->costMs = w25q->eraseTiming.block64kEraseMs;
+	}
+	else if((memAddress % halfSize) == 0 && (endAddress - memAddress) >= halfSize &&
+			w25q->eraseTiming.block32kEraseMs <= (w25q->eraseTiming.sectorEraseMs * sectorsPerHalf))
+	{
+		step->command = w25q->block32kEraseCommand;
+		step->size = halfSize;
+		step->costMs = w25q->eraseTiming.block32kEraseMs;
+	}
+	else
+	{
+		step->command = w25q->sectorEraseCommand;
+		step->size = w25q->sectorSize;
+		step->costMs = w25q->eraseTiming.sectorEraseMs;
+	}
+}
+
+static W25Q_Status W25Q_CheckEraseRange(uint32_t memAddress, uint32_t length)
+{
+	if((memAddress % w25q->sectorSize) != 0 || (length % w25q->sectorSize) != 0 ||
+	   memAddress > w25q->byteCount || length > (w25q->byteCount - memAddress))
+	{
+		return W25Q_ERROR_PARAM;
+	}
+	return W25Q_OK;
+}
+
+/**
+ * @brief	Estimates how long W25Q_EraseRange() takes for the given range
+ * @return	Typical erase time in milliseconds, 0 for an invalid range
+ */
+uint32_t W25Q_EstimateEraseRange(uint32_t memAddress, uint32_t length)
+{
+	PROFILE_FUNCTION();
+	W25Q_EraseStep step;
+	uint32_t totalMs = 0;
+	uint32_t endAddress = memAddress + length;
+
+	if(W25Q_CheckEraseRange(memAddress, length) != W25Q_OK)
+	{
+		return 0;
+	}
+	while(memAddress < endAddress)
+	{
+		W25Q_PlanEraseStep(memAddress, endAddress, &step);
+		totalMs += step.costMs;
+		memAddress += step.size;
+	}
+	return totalMs;
+}
+
+/**
+ * @brief	Erases a sector aligned range with the cheapest mix of 4K, 32K
+ * 			and 64K erase commands
+ * @param	memAddress	Start address, multiple of w25q->sectorSize
+ * @param	length		Number of bytes, multiple of w25q->sectorSize
+ */
+W25Q_Status W25Q_EraseRange(uint32_t memAddress, uint32_t length)
+{
+	PROFILE_FUNCTION();
+	W25Q_EraseStep step;
+	W25Q_Status status = W25Q_CheckEraseRange(memAddress, length);
+	uint32_t endAddress = memAddress + length;
+	uint32_t timeoutMs;
+
+	uint32_t runEnd;
+
+	while(status == W25Q_OK && memAddress < endAddress)
+	{
+		if(W25Q_IsKnownErased(memAddress, w25q->sectorSize))
+		{
+			memAddress += w25q->sectorSize;
+			continue;
+		}
+
+		// Plan only across the run of sectors that still need erasing
+		runEnd = memAddress + w25q->sectorSize;
+		while(runEnd < endAddress && !W25Q_IsKnownErased(runEnd, w25q->sectorSize))
+		{
+			runEnd += w25q->sectorSize;
+		}
+		W25Q_PlanEraseStep(memAddress, runEnd, &step);
+		if(step.size == w25q->blockSize)
+		{
+			timeoutMs = w25q->eraseTimeout.block64kEraseMs;
+		}
+		else if(step.size == w25q->blockSize / 2)
+		{
+			timeoutMs = w25q->eraseTimeout.block32kEraseMs;
+		}
+		else
+		{
+			timeoutMs = w25q->eraseTimeout.sectorEraseMs;
+		}
+		status = W25Q_CompleteIfStarted(W25Q_StartErase(step.command, step.address, step.size, timeoutMs));
+		memAddress += step.size;
+	}
+	return status;
+}
+
+/**
+ * @brief	Checks whether a range reads back as erased (all 0xFF) using
+ * 			a single FAST_READ compared a word at a time
+ * @param	memAddress	Start address, multiple of 4
+ * @param	length		Number of bytes, multiple of 4
+ * @return	1 if every byte is 0xFF, 0 otherwise or while a stream is open
+ */
+uint8_t W25Q_BlankCheck(uint32_t memAddress, uint32_t length)
+{
+	PROFILE_FUNCTION();
+	uint32_t chunk[64];
+	uint32_t chunkLength;
+	uint8_t blank = 1;
+	uint8_t resume;
+
+	if(w25q->streamOpen)
+	{
+		return 0;
+	}
+	resume = W25Q_PrepareRead(memAddress, length);
+
+	W25Q_Select();
+	W25Q_SendCommandAddress(FAST_READ, memAddress);
+	W25Q_TransferByte(0x00);
+	while(blank && length > 0)
+	{
+		chunkLength = (length < sizeof(chunk)) ? length : sizeof(chunk);
+		W25Q_Transfer(NULL, (uint8_t *)chunk, chunkLength);
+		for(uint32_t i = 0; i < chunkLength / 4; i++)
+		{
+			if(chunk[i] != 0xFFFFFFFF)
+			{
+				blank = 0;
+				break;
+			}
+		}
+		length -= chunkLength;
+	}
+	W25Q_Deselect();
+	if(resume)
+	{
+		W25Q_Resume();
+	}
+	return blank;
+}
+
+/**
+ * @brief	Blank-checks every sector of a range and records the blank ones,
+ * 			so later erases of them are skipped
+ * @param	memAddress	Start address, multiple of w25q->sectorSize
+ * @param	length		Number of bytes, multiple of w25q->sectorSize
+ * @return	Number of sectors found blank
+ */
+uint32_t W25Q_ScanErased(uint32_t memAddress, uint32_t length)
+{
+	PROFILE_FUNCTION();
+	uint32_t blankSectors = 0;
+
+	if(W25Q_CheckEraseRange(memAddress, length) != W25Q_OK)
+	{
+		return 0;
+	}
+	for(uint32_t address = memAddress; address < memAddress + length; address += w25q->sectorSize)
+	{
+		uint8_t blank = W25Q_BlankCheck(address, w25q->sectorSize);
+		W25Q_MarkErased(address, w25q->sectorSize, blank);
+		blankSectors += blank;
+	}
+	return blankSectors;
 }
 
 uint8_t W25Q_ReadStatusRegister1(void)
 {
+	PROFILE_FUNCTION();
 	uint8_t statusReg;
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	statusReg = SPI2_TransmitReceiveByte(READ_STATUS_R1);
-	SPI2_DeselectSlave();
+	W25Q_Select();
+	W25Q_TransferByte(READ_STATUS_R1);
+	statusReg = W25Q_TransferByte(0xFF);
+	W25Q_Deselect();
 	return statusReg;
 }
 
 uint8_t W25Q_ReadStatusRegister2(void)
 {
+	PROFILE_FUNCTION();
 	uint8_t statusReg;
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	statusReg = SPI2_TransmitReceiveByte(READ_STATUS_R2);
-	SPI2_DeselectSlave();
+	W25Q_Select();
+	W25Q_TransferByte(READ_STATUS_R2);
+	statusReg = W25Q_TransferByte(0xFF);
+	W25Q_Deselect();
 	return statusReg;
 }
 
-void W25Q_WriteStatusRegister(uint8_t statusReg1, uint8_t statusReg2)
+uint8_t W25Q_ReadStatusRegister3(void)
 {
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(WRITE_STATUS_REG);
-	SPI2_TransmitReceiveByte(statusReg1);
-	SPI2_TransmitReceiveByte(statusReg2);
-	SPI2_DeselectSlave();
+	PROFILE_FUNCTION();
+	uint8_t statusReg;
+	W25Q_Select();
+	W25Q_TransferByte(READ_STATUS_R3);
+	statusReg = W25Q_TransferByte(0xFF);
+	W25Q_Deselect();
+	return statusReg;
 }
-void W25Q_WriteSecurityRegister(uint8_t reg, uint8_t offset, uint8_t *data, uint16_t len)
+
+W25Q_Status W25Q_WriteStatusRegister(uint8_t statusReg1, uint8_t statusReg2)
 {
-	uint32_t memAddress;
+	PROFILE_FUNCTION();
+	W25Q_Status status;
 
-	switch(reg)
+	if(W25Q_Busy())
 	{
-		case '1':	memAddress = SECURITY_REG_1; break;
-		case '2':	memAddress = SECURITY_REG_2; break;
-		case '3':	memAddress = SECURITY_REG_3; break;
-		default : 	break;
+		return W25Q_ERROR_BUSY;
+	}
+	status = W25Q_WriteEnable();
+	if(status != W25Q_OK)
+	{
+		return status;
+	}
+	W25Q_Select();
+	W25Q_TransferByte(WRITE_STATUS_REG);
+	W25Q_TransferByte(statusReg1);
+	W25Q_TransferByte(statusReg2);
+	W25Q_Deselect();
+	return W25Q_WaitReady(W25Q_TIMEOUT_STATUS_WRITE);
+}
+
+W25Q_Status W25Q_WriteSecurityRegister(uint8_t reg, uint8_t offset, uint8_t *data, uint16_t len)
+{
+	PROFILE_FUNCTION();
+	uint32_t memAddress = W25Q_GetSecurityRegisterAddress(reg);
+	W25Q_Status status;
+
+	if(memAddress == 0)
+	{
+		return W25Q_ERROR_PARAM;
 	}
 
 	memAddress = memAddress + offset;
 
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(WRITE_SECURITY_REG);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	for (uint8_t i = 0; i < len; i++)
+	if(W25Q_Busy())
+	{
+		return W25Q_ERROR_BUSY;
+	}
+	status = W25Q_WriteEnable();
+	if(status != W25Q_OK)
 	{
-		// Send data and discard dummy data
-		SPI2_TransmitReceiveByte(data[i]);
+		return status;
 	}
-	SPI2_DeselectSlave();
+	W25Q_Select();
+	W25Q_SendCommandAddress(WRITE_SECURITY_REG, memAddress);
+	W25Q_Transfer(data, NULL, len);
+	W25Q_Deselect();
+	w25q->job.remaining = 0;
+	w25q->job.eraseSize = 0;
+	return W25Q_CompleteIfStarted(W25Q_StartJob(W25Q_TIMEOUT_PAGE_PROGRAM));
 }
 
-void W25Q_ReadSecurityRegister(uint8_t reg, uint8_t offset, uint8_t *data, uint16_t len)
+W25Q_Status W25Q_ReadSecurityRegister(uint8_t reg, uint8_t offset, uint8_t *data, uint16_t len)
 {
-	uint32_t memAddress;
+	PROFILE_FUNCTION();
+	uint32_t memAddress = W25Q_GetSecurityRegisterAddress(reg);
 
-	switch(reg)
+	if(memAddress == 0)
 	{
-		case '1':	memAddress = SECURITY_REG_1; break;
-		case '2':	memAddress = SECURITY_REG_2; break;
-		case '3':	memAddress = SECURITY_REG_3; break;
-		default : 	break;
+		return W25Q_ERROR_PARAM;
 	}
 
 	memAddress = memAddress + offset;
 
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(READ_SECURITY_REG);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	for (uint8_t i = 0; i < len; i++)
+	if(w25q->streamOpen)
 	{
-		// Send dummy byte and receive data
-		data[i] = SPI2_TransmitReceiveByte(0xFF);
+		return W25Q_ERROR_BUSY;
 	}
-	SPI2_DeselectSlave();
+	W25Q_WaitJob();
+	W25Q_Select();
+	W25Q_SendCommandAddress(READ_SECURITY_REG, memAddress);
+	// One dummy byte follows the address
+	W25Q_TransferByte(0xFF);
+	W25Q_Transfer(NULL, data, len);
+	W25Q_Deselect();
+	return W25Q_OK;
 }
 
-void W25Q_EraseSecurityRegister(uint8_t reg)
+W25Q_Status W25Q_EraseSecurityRegister(uint8_t reg)
 {
-	uint32_t memAddress;
+	PROFILE_FUNCTION();
+	uint32_t memAddress = W25Q_GetSecurityRegisterAddress(reg);
 
-	switch(reg)
+	if(memAddress == 0)
 	{
-		case '1':	memAddress = SECURITY_REG_1; break;
-		case '2':	memAddress = SECURITY_REG_2; break;
-		case '3':	memAddress = SECURITY_REG_3; break;
-		default : 	break;
+		return W25Q_ERROR_PARAM;
 	}
 
-	W25Q_WriteEnable();
-	SPI2_SelectSlave();
-	SPI2_TransmitReceiveByte(ERASE_SECURITY_REG);
-	SPI2_TransmitReceiveByte((memAddress >> 16) & 0xFF);
-	SPI2_TransmitReceiveByte((memAddress >> 8) & 0xFF);
-	SPI2_TransmitReceiveByte(memAddress & 0xFF);
-	SPI2_DeselectSlave();
+	return W25Q_CompleteIfStarted(W25Q_StartErase(ERASE_SECURITY_REG, memAddress, 0, W25Q_TIMEOUT_SECTOR_ERASE));
 }
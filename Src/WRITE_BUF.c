@@ -0,0 +1,138 @@
+#include <string.h>
+#include "WRITE_BUF.h"
+#include "SYSTICK.h"
+
+/**
+ * @brief	Prepares an empty write buffer
+ * @param	buffer		Buffer to initialise
+ * @param	timeoutMs	Idle time after which WBUF_Poll() flushes a partial
+ * 						page, 0 to only flush on page boundary or sync
+ */
+void WBUF_Init(WBUF_Buffer *buffer, uint32_t timeoutMs)
+{
+	buffer->pageNumber = 0;
+	buffer->start = 0;
+	buffer->end = 0;
+	buffer->lastWriteMs = get_ticks();
+	buffer->timeoutMs = timeoutMs;
+	buffer->fragments = 0;
+	buffer->pagePrograms = 0;
+}
+
+/**
+ * @brief	Programs the buffered bytes of the current page, if any. On
+ * 			failure the bytes stay buffered so a later sync can retry them.
+ */
+W25Q_Status WBUF_Sync(WBUF_Buffer *buffer)
+{
+	W25Q_Status status = W25Q_OK;
+
+	if(buffer->end > buffer->start)
+	{
+		status = W25Q_WriteData(buffer->pageNumber, buffer->start, buffer->end - buffer->start,
+								&buffer->page[buffer->start]);
+		if(status != W25Q_OK)
+		{
+			return status;
+		}
+		buffer->pagePrograms++;
+	}
+	buffer->start = 0;
+	buffer->end = 0;
+	return status;
+}
+
+/**
+ * @brief	Buffers a write. The page is programmed once it fills up, or
+ * 			earlier if the write does not continue where the last one ended.
+ * 			Reads of buffered bytes return stale data until WBUF_Sync().
+ * @param	buffer		Write buffer
+ * @param	memAddress	Flash address of the first byte
+ * @param	data		Bytes to write
+ * @param	length		Number of bytes to write
+ * @return	W25Q_ERROR_PARAM if the selected device's pages do not fit the buffer
+ */
+W25Q_Status WBUF_Write(WBUF_Buffer *buffer, uint32_t memAddress, const uint8_t *data, uint32_t length)
+{
+	W25Q_Status status = W25Q_OK;
+	uint32_t pageSize = W25Q_GetDevice()->pageSize;
+	uint32_t pageNumber;
+	uint16_t offset;
+	uint32_t bytesToCopy;
+
+	if(pageSize == 0 || pageSize > W25Q_MAX_PAGE_SIZE)
+	{
+		return W25Q_ERROR_PARAM;
+	}
+
+	while(status == W25Q_OK && length > 0)
+	{
+		pageNumber = memAddress / pageSize;
+		offset = memAddress % pageSize;
+
+		// Only a write continuing the buffered run can join it
+		if(buffer->end > buffer->start && (pageNumber != buffer->pageNumber || offset != buffer->end))
+		{
+			status = WBUF_Sync(buffer);
+			if(status != W25Q_OK)
+			{
+				break;
+			}
+		}
+		if(buffer->end == buffer->start)
+		{
+			buffer->pageNumber = pageNumber;
+			buffer->start = offset;
+			buffer->end = offset;
+		}
+
+		bytesToCopy = pageSize - offset;
+		if(length < bytesToCopy)
+		{
+			bytesToCopy = length;
+		}
+		memcpy(&buffer->page[offset], data, bytesToCopy);
+		buffer->end += bytesToCopy;
+		buffer->lastWriteMs = get_ticks();
+		buffer->fragments++;
+
+		if(buffer->end == pageSize)
+		{
+			status = WBUF_Sync(buffer);
+		}
+
+		memAddress += bytesToCopy;
+		data += bytesToCopy;
+		length -= bytesToCopy;
+	}
+	return status;
+}
+
+/**
+ * @brief	Flushes a partial page once no write has reached it for the
+ * 			timeout, measured on the get_ticks() timebase. Call from the
+ * 			main loop.
+ * @param	buffer		Write buffer
+ */
+W25Q_Status WBUF_Poll(WBUF_Buffer *buffer)
+{
+	if(buffer->end == buffer->start || buffer->timeoutMs == 0)
+	{
+		return W25Q_OK;
+	}
+	if((uint32_t)(get_ticks() - buffer->lastWriteMs) < buffer->timeoutMs)
+	{
+		return W25Q_OK;
+	}
+	return WBUF_Sync(buffer);
+}
+
+/**
+ * @brief	Returns how many page programs buffering has saved, compared
+ * 			to programming every written fragment on its own
+ */
+uint32_t WBUF_ProgramsAvoided(WBUF_Buffer *buffer)
+{
+	uint32_t pending = (buffer->end > buffer->start) ? 1 : 0;
+	return buffer->fragments - buffer->pagePrograms - pending;
+}
@@ -1,7 +1,12 @@
 #include <stdint.h>
+#include "CLOCK.h"
 #include "UART.h"
 #include "LED.h"
+#include "W25Qxx.h"
 #include "SWAP_FS.h"
+#include "COMMANDS.h"
+#include "TRACE.h"
+#include "TELEMETRY.h"
 
 int main()
 {
@@ -9,14 +14,24 @@ int main()
 	uint8_t blockMapArray[128];
 	uint8_t data[4096] = "";
 
+	CLOCK_Init();
 	LED_Init();
 	UART2_Init();
+	W25Q_Init();
+#if TLM_AT_BOOT
+	// Before the file system mounts, so the stream opens with its tables
+	TLM_Init(UART2_Write);
+#endif
 
 	SFS_InitFS();
 	SFS_ReadFS(eraseCountArray, blockMapArray);
+	CMD_Init(eraseCountArray, blockMapArray);
+	TRACE_Init(UART2_Write);
 
 	while(1)
 	{
+		CMD_Poll();
+		TRACE_Poll();
 		SFS_WriteData(eraseCountArray, blockMapArray, 5, data, 4096);
 	}
 }